@@ -0,0 +1,57 @@
+/**
+ * Step many independent worlds at once on a pool of threads:
+ * implementation
+ * @author Scott LaVigne
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "batch.h"
+
+typedef struct Batch {
+  World** worlds;
+  int num_worlds;
+  int ticks;
+  int next; // next world to hand out, taken atomically
+} Batch;
+
+static void* worker(void* vbatch) {
+  Batch* batch = vbatch;
+  int i, j;
+  while ((i = __sync_fetch_and_add(&batch->next, 1)) < batch->num_worlds) {
+    for (j = 0; j < batch->ticks; j++)
+      world_step(batch->worlds[i]);
+  }
+  return NULL;
+}
+
+void batch_run(World** worlds, int num_worlds, int ticks, int threads) {
+  Batch batch = {worlds, num_worlds, ticks, 0};
+  pthread_t* pool;
+  int i, started = 0;
+
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > num_worlds)
+    threads = num_worlds;
+  if (threads <= 1) {
+    worker(&batch);
+    return;
+  }
+
+  // the calling thread works too
+  pool = malloc(sizeof(pthread_t) * (threads - 1));
+  for (i = 0; i < threads - 1; i++) {
+    if (pthread_create(&pool[started], NULL, worker, &batch) != 0) {
+      printf("Could only start %d batch threads\n", started + 1);
+      break;
+    }
+    started++;
+  }
+  worker(&batch);
+  for (i = 0; i < started; i++)
+    pthread_join(pool[i], NULL);
+  free(pool);
+}
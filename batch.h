@@ -0,0 +1,22 @@
+/**
+ * Step many independent worlds at once on a pool of threads
+ * @author Scott LaVigne
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "world.h"
+
+/**
+ * Step every world a number of ticks. Each world is stepped by one
+ * thread at a time, whole, so its bodies and callbacks never see
+ * another thread; worlds must not share bodies or callback data.
+ * Threads take the next unstepped world until none are left.
+ * @param worlds     worlds to step
+ * @param num_worlds number of worlds
+ * @param ticks      ticks to step each world
+ * @param threads    threads to use, or 0 for one per processor
+ */
+void batch_run(World** worlds, int num_worlds, int ticks, int threads);
+
+#endif /* BATCH_H */
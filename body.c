@@ -13,12 +13,13 @@
 #include <GL/freeglut_ext.h>
 
 #include "body.h"
+#include "world.h"
 #include "shader.h"
 #include "list.h"
+#include "mem.h"
 
 Pipeline* body_program;
 unsigned body_vao;
-List* bodies;
 
 typedef struct CollisionCallback {
   Body* body;
@@ -27,15 +28,30 @@ typedef struct CollisionCallback {
   void* data;
 } CollisionCallback;
 
-typedef struct CollisionHandler {
-  float depth;
-  vec2 normal;
-  Edge* edge;
-  vec2* vertex;
-  struct Body* parent;
-} CollisionHandler;
+// center of mass and bbox from the points
+static void update_bounds(Body* body) {
+  int i;
+  body->center_of_mass[0] = 0.0;
+  body->center_of_mass[1] = 0.0;
+
+  body->bbox[0] = 10000.0f;
+  body->bbox[1] = 10000.0f;
+  body->bbox[2] = -10000.0f;
+  body->bbox[3] = -10000.0f;
+
+  for (i = 0; i < body->num_points; i++) {
+    body->center_of_mass[0] += body->points[i][0];
+    body->center_of_mass[1] += body->points[i][1];
 
-static CollisionHandler handler;
+    body->bbox[0] = min(body->bbox[0], body->points[i][0]);
+    body->bbox[1] = min(body->bbox[1], body->points[i][1]);
+    body->bbox[2] = max(body->bbox[2], body->points[i][0]);
+    body->bbox[3] = max(body->bbox[3], body->points[i][1]);
+  }
+
+  body->center_of_mass[0] /= body->num_points;
+  body->center_of_mass[1] /= body->num_points;
+}
 
 Body* body_new(
   vec2* points,
@@ -45,12 +61,16 @@ Body* body_new(
   int num_edges)
 {
   int i;
-  Body* body = malloc(sizeof(Body));
+  Body* body = mem_alloc(MEM_BODIES, sizeof(Body));
+  body->world = NULL;
+  body->id = -1;
+  body->type = BODY_DYNAMIC;
   body->colors = colors;
-  body->points = malloc(sizeof(vec2) * num_points);
-  body->last_points = malloc(sizeof(vec2) * num_points);
+  body->points = mem_alloc(MEM_POINTS, sizeof(vec2) * num_points);
+  body->last_points = mem_alloc(MEM_POINTS, sizeof(vec2) * num_points);
   body->num_points = num_points;
-  body->edges = malloc(sizeof(Edge) * num_edges);
+  body->first_point = -1;
+  body->edges = mem_alloc(MEM_EDGES, sizeof(Edge) * num_edges);
   body->num_edges = num_edges;
   memcpy(body->points, points, sizeof(vec2) * num_points);
   memcpy(body->last_points, points, sizeof(vec2) * num_points);
@@ -66,17 +86,22 @@ Body* body_new(
   }
 
   body->step_callback = NULL;
-
-  glGenBuffers(1, &body->vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, body->vbo);
-  glBufferData(GL_ARRAY_BUFFER, (sizeof(vec2) + sizeof(vec3)) * num_points,
-    NULL, GL_DYNAMIC_DRAW);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec2) * num_points, body->points);
-  glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec2) * num_points,
-    sizeof(vec3) * num_points, body->colors);
-
-  // bounding box calculates mass
-  body_do_center(body);
+  body->proxy = -1;
+  body->rigid = false;
+  body->local_points = mem_alloc(MEM_POINTS, sizeof(vec2) * num_points);
+  body->points_dirty = false;
+  body->points_touched = false;
+  body->pushes = mem_calloc(MEM_POINTS, num_points, sizeof(vec2x));
+  body->pressure = 0.0;
+  body->rest_area = 0.0;
+  body->shape_match = 0.0;
+  body->outline = NULL;
+  body->rest_shape = NULL;
+  body->vbo = 0;
+
+  // bounding box calculates mass. The body joins the dynamic tree
+  // once it is simulated.
+  update_bounds(body);
   body->mass = fabs(body->bbox[0] - body->bbox[2]) * fabs(body->bbox[1] - body->bbox[3]);
   
   body->collision_callbacks = list_new();
@@ -84,24 +109,301 @@ Body* body_new(
   body->mask = 0x01;
   body->boxed = true;
   body->wire = false;
+  body->lod = BODY_LOD_FULL;
+  body->lod_hold = 0;
+  body->num_joints = 0;
   return body;
 }
 
-void body_do_verlet(Body* body, double dt) {
+void body_free(Body* body) {
+  CollisionCallback* callback;
+  if (body->vbo != 0) {
+    glDeleteBuffers(1, &body->vbo);
+    mem_track(MEM_GPU, -(long) ((sizeof(vec2) + sizeof(vec3))
+      * body->num_points));
+  }
+  while ((callback = list_pop_front(body->collision_callbacks)) != NULL)
+    mem_free(callback);
+  list_free(body->collision_callbacks);
+
+  // pooled points belong to the world
+  if (body->first_point < 0) {
+    mem_free(body->points);
+    mem_free(body->last_points);
+  }
+  mem_free(body->edges);
+  mem_free(body->local_points);
+  mem_free(body->pushes);
+  mem_free(body->rest_shape);
+  mem_free(body->outline);
+  mem_free(body);
+}
+
+void body_move_points(Body* body, vec2* points, vec2* last_points) {
+  World* world = body->world;
+  int i;
+
+  // edges and the contact point into the old storage, which is still
+  // there to measure offsets from
+  for (i = 0; i < body->num_edges; i++) {
+    Edge* edge = &body->edges[i];
+    edge->point1 = points + (edge->point1 - body->points);
+    edge->point2 = points + (edge->point2 - body->points);
+  }
+  if (world != NULL && world->contact.parent == body
+    && world->contact.vertex != NULL)
+    world->contact.vertex = points + (world->contact.vertex - body->points);
+  body->points = points;
+  body->last_points = last_points;
+}
+
+// center of mass of a set of points
+static void points_center(vec2* points, int num_points, vec2 center) {
+  int i;
+  center[0] = center[1] = 0.0;
+  for (i = 0; i < num_points; i++) {
+    center[0] += points[i][0];
+    center[1] += points[i][1];
+  }
+  center[0] /= num_points;
+  center[1] /= num_points;
+}
+
+// angle of the rotation about their centers that best maps one set of
+// points onto another
+static float points_rotation(vec2* from, vec2 from_center,
+  vec2* to, vec2 to_center, int num_points)
+{
+  float cross = 0.0, dot = 0.0;
+  int i;
+  for (i = 0; i < num_points; i++) {
+    float ax = from[i][0] - from_center[0];
+    float ay = from[i][1] - from_center[1];
+    float bx = to[i][0] - to_center[0];
+    float by = to[i][1] - to_center[1];
+    cross += ax * by - ay * bx;
+    dot += ax * bx + ay * by;
+  }
+  return atan2(cross, dot);
+}
+
+static float wrap_angle(float angle) {
+  while (angle > M_PI)
+    angle -= 2.0 * M_PI;
+  while (angle < -M_PI)
+    angle += 2.0 * M_PI;
+  return angle;
+}
+
+// place the shape of a rigid body at a position and angle
+static void rigid_transform(Body* body, vec2 position, float angle,
+  vec2* out)
+{
+  float c = cos(angle), s = sin(angle);
+  int i;
+  for (i = 0; i < body->num_points; i++) {
+    float x = body->local_points[i][0];
+    float y = body->local_points[i][1];
+    out[i][0] = position[0] + x * c - y * s;
+    out[i][1] = position[1] + x * s + y * c;
+  }
+}
+
+// fit the shape to points pushed by collisions, the push becomes velocity
+static void rigid_absorb(Body* body) {
+  vec2 center, origin = {0.0, 0.0};
+  float angle;
+
+  if (body->points_touched == false)
+    return;
+
+  points_center(body->points, body->num_points, center);
+  angle = points_rotation(body->local_points, origin,
+    body->points, center, body->num_points);
+
+  body->velocity[0] += center[0] - body->position[0];
+  body->velocity[1] += center[1] - body->position[1];
+  body->angular_velocity += wrap_angle(angle - body->angle);
+  body->position[0] = center[0];
+  body->position[1] = center[1];
+  body->angle = angle;
+  body->points_touched = false;
+  body->points_dirty = true;
+}
+
+void body_set_type(Body* body, BodyType type) {
+  World* world = body->world;
+  if (body->type == type)
+    return;
+  if (world != NULL && (body->type == BODY_STATIC || type == BODY_STATIC)) {
+    world->static_dirty = true;
+    world->static_version++;
+  }
+  if (type == BODY_STATIC && body->proxy >= 0) {
+    tree_remove(world->dynamic_tree, body->proxy);
+    body->proxy = -1;
+  }
+  body->type = type;
+  if (type == BODY_STATIC)
+    body_do_center(world, body);
+}
+
+void body_set_rigid(Body* body, bool rigid) {
+  vec2 last_center, last_position;
+  int i;
+
+  if (body->rigid == rigid)
+    return;
+
+  if (rigid) {
+    // the current pose becomes the shape, motion since the last step
+    // becomes the velocity
+    points_center(body->points, body->num_points, body->position);
+    points_center(body->last_points, body->num_points, last_center);
+    for (i = 0; i < body->num_points; i++) {
+      body->local_points[i][0] = body->points[i][0] - body->position[0];
+      body->local_points[i][1] = body->points[i][1] - body->position[1];
+    }
+    body->angle = 0.0;
+    body->velocity[0] = body->position[0] - last_center[0];
+    body->velocity[1] = body->position[1] - last_center[1];
+    body->angular_velocity = points_rotation(body->last_points, last_center,
+      body->points, body->position, body->num_points);
+    body->points_dirty = false;
+    body->points_touched = false;
+  } else {
+    // rebuild the previous pose so verlet carries the velocity on
+    body_sync_points(body);
+    last_position[0] = body->position[0] - body->velocity[0];
+    last_position[1] = body->position[1] - body->velocity[1];
+    rigid_transform(body, last_position,
+      body->angle - body->angular_velocity, body->last_points);
+  }
+  body->rigid = rigid;
+}
+
+void body_sync_points(Body* body) {
+  if (body->rigid == false)
+    return;
+  rigid_absorb(body);
+  if (body->points_dirty) {
+    rigid_transform(body, body->position, body->angle, body->points);
+    body->points_dirty = false;
+  }
+}
+
+static void body_do_rigid_verlet(World* world, Body* body) {
+  float* bounds = world->bounds;
   int i;
+  rigid_absorb(body);
+
+  if (body->gravity == true && body->type == BODY_DYNAMIC)
+    body->velocity[1] -= world->gravity;
+  body->position[0] += body->velocity[0];
+  body->position[1] += body->velocity[1];
+  body->angle = wrap_angle(body->angle + body->angular_velocity);
+  body->points_dirty = true;
+
+  if (body->boxed) {
+    // push the whole shape back inside, stopping it on that axis
+    float dx = 0.0, dy = 0.0;
+    body_sync_points(body);
+    for (i = 0; i < body->num_points; i++) {
+      dx = max(dx, bounds[0] - body->points[i][0]);
+      dx = min(dx, bounds[2] - body->points[i][0]);
+      dy = max(dy, bounds[1] - body->points[i][1]);
+      dy = min(dy, bounds[3] - body->points[i][1]);
+    }
+    if (dx != 0.0 || dy != 0.0) {
+      body->position[0] += dx;
+      body->position[1] += dy;
+      if (dx != 0.0)
+        body->velocity[0] = 0.0;
+      if (dy != 0.0)
+        body->velocity[1] = 0.0;
+      body->points_dirty = true;
+    }
+  }
+}
+
+// largest stretch of any edge, relative to its rest length
+static float body_deformation(Body* body) {
+  float worst = 0.0;
+  int i;
+  for (i = 0; i < body->num_edges; i++) {
+    Edge* edge = &body->edges[i];
+    float dx = (*edge->point1)[0] - (*edge->point2)[0];
+    float dy = (*edge->point1)[1] - (*edge->point2)[1];
+    if (edge->length > 0.0)
+      worst = max(worst, fabs(sqrt(dx*dx + dy*dy) - edge->length) / edge->length);
+  }
+  return worst;
+}
+
+// bring a body back to full detail for a while
+static void body_wake(Body* body) {
+  if (body->lod == BODY_LOD_FROZEN)
+    body_set_rigid(body, false);
+  body->lod = BODY_LOD_FULL;
+  body->lod_hold = BODY_LOD_HOLD;
+}
+
+void body_do_lod(World* world, Body* body) {
+  float* view = world->view;
+  // distance from the view, zero when inside it
+  float dx = max(max(view[0] - body->bbox[2], body->bbox[0] - view[2]), 0.0);
+  float dy = max(max(view[1] - body->bbox[3], body->bbox[1] - view[3]), 0.0);
+  BodyLod lod;
+
+  // static or rigid by choice, there is nothing to reduce
+  if (body->type == BODY_STATIC
+    || (body->rigid && body->lod != BODY_LOD_FROZEN))
+    return;
+
+  if (body->lod_hold > 0) {
+    body->lod_hold--;
+    lod = BODY_LOD_FULL;
+  } else if (body->num_joints > 0) {
+    lod = BODY_LOD_FULL;
+  } else if (dx <= BODY_LOD_MARGIN && dy <= BODY_LOD_MARGIN) {
+    lod = BODY_LOD_FULL;
+  } else if (body->lod == BODY_LOD_FROZEN
+    || body_deformation(body) < BODY_LOD_FREEZE) {
+    lod = BODY_LOD_FROZEN;
+  } else {
+    lod = BODY_LOD_REDUCED;
+  }
+
+  if (lod == BODY_LOD_FROZEN && body->lod != BODY_LOD_FROZEN)
+    body_set_rigid(body, true);
+  else if (lod != BODY_LOD_FROZEN && body->lod == BODY_LOD_FROZEN)
+    body_set_rigid(body, false);
+  body->lod = lod;
+}
+
+void body_do_verlet(World* world, Body* body, double dt) {
+  float* bounds = world->bounds;
+  int i;
+  if (body->type == BODY_STATIC)
+    return;
+  if (body->rigid) {
+    body_do_rigid_verlet(world, body);
+    return;
+  }
+
   for (i = 0; i < body->num_points; i++) {
     float nx = body->points[i][0]+body->points[i][0]-body->last_points[i][0];
     float ny;
-    if (body->gravity == true)
-      ny = body->points[i][1]+body->points[i][1]-body->last_points[i][1]-0.25;
+    if (body->gravity == true && body->type == BODY_DYNAMIC)
+      ny = body->points[i][1]+body->points[i][1]-body->last_points[i][1]-world->gravity;
     else
       ny = body->points[i][1]+body->points[i][1]-body->last_points[i][1];
     body->last_points[i][0] = body->points[i][0];
     body->last_points[i][1] = body->points[i][1];
 
     if (body->boxed) {
-      body->points[i][0] = min(max(nx, 0.0), 800.0);
-      body->points[i][1] = min(max(ny, 0.0), 600.0);
+      body->points[i][0] = clamp(nx, bounds[0], bounds[2]);
+      body->points[i][1] = clamp(ny, bounds[1], bounds[3]);
     } else {
       body->points[i][0] = nx;
       body->points[i][1] = ny;
@@ -109,29 +411,174 @@ void body_do_verlet(Body* body, double dt) {
   }
 }
 
-void body_do_step(Body* body, double dt) {
+void body_do_step(World* world, Body* body, double dt) {
   if (body->step_callback)
     body->step_callback(body, dt, body->step_data);
 }
 
+// order offsets from a center by angle, exactly, without trig: the
+// half plane first, then which side of each other they are
+static int compare_angles(const void* va, const void* vb) {
+  const float* a = va;
+  const float* b = vb;
+  float ax = a[0], ay = a[1], bx = b[0], by = b[1];
+  bool upper_a = ay > 0.0 || (ay == 0.0 && ax >= 0.0);
+  bool upper_b = by > 0.0 || (by == 0.0 && bx >= 0.0);
+  float cross;
+  if (upper_a != upper_b)
+    return upper_a? -1 : 1;
+  cross = ax * by - ay * bx;
+  return (cross > 0.0)? -1 : (cross < 0.0)? 1 : 0;
+}
+
+// signed area inside the outline, positive since it runs anticlockwise
+static float outline_area(Body* body) {
+  float area = 0.0;
+  int i;
+  for (i = 0; i < body->num_points; i++) {
+    float* p = body->points[body->outline[i]];
+    float* q = body->points[body->outline[(i + 1) % body->num_points]];
+    area += p[0] * q[1] - q[0] * p[1];
+  }
+  return 0.5f * area;
+}
+
+// work out the outline and rest shape the first time either is needed;
+// they stay as they were captured after
+static void set_rest_shape(Body* body) {
+  vec3* sorted;
+  vec2 center;
+  int i;
+
+  if (body->outline != NULL)
+    return;
+  body_sync_points(body);
+  points_center(body->points, body->num_points, center);
+  body->rest_shape = mem_alloc(MEM_POINTS, sizeof(vec2) * body->num_points);
+  for (i = 0; i < body->num_points; i++) {
+    body->rest_shape[i][0] = body->points[i][0] - center[0];
+    body->rest_shape[i][1] = body->points[i][1] - center[1];
+  }
+
+  // sort the offsets with their indices along, in the third component
+  sorted = mem_alloc(MEM_POINTS, sizeof(vec3) * body->num_points);
+  for (i = 0; i < body->num_points; i++) {
+    sorted[i][0] = body->rest_shape[i][0];
+    sorted[i][1] = body->rest_shape[i][1];
+    sorted[i][2] = i;
+  }
+  qsort(sorted, body->num_points, sizeof(vec3), compare_angles);
+  body->outline = mem_alloc(MEM_POINTS, sizeof(int) * body->num_points);
+  for (i = 0; i < body->num_points; i++)
+    body->outline[i] = (int) sorted[i][2];
+  mem_free(sorted);
+
+  body->rest_area = outline_area(body);
+}
+
+void body_set_pressure(Body* body, float stiffness) {
+  set_rest_shape(body);
+  body->pressure = (stiffness > 0.0)? stiffness : 0.0;
+}
+
+void body_set_shape_match(Body* body, float stiffness) {
+  set_rest_shape(body);
+  body->shape_match = (stiffness > 0.0)? stiffness : 0.0;
+}
+
+// move every point along the area's gradient by the amount that takes
+// out the area error, scaled by the stiffness. A point's gradient
+// comes from its neighbours on the outline, from before any moved.
+static void do_pressure(Body* body) {
+  int n = body->num_points, i;
+  float error = outline_area(body) - body->rest_area;
+  float norm = 0.0, scale;
+  vec2 first, last, grad;
+
+  for (i = 0; i < n; i++) {
+    float* prev = body->points[body->outline[(i + n - 1) % n]];
+    float* next = body->points[body->outline[(i + 1) % n]];
+    grad[0] = 0.5f * (next[1] - prev[1]);
+    grad[1] = 0.5f * (prev[0] - next[0]);
+    norm += grad[0] * grad[0] + grad[1] * grad[1];
+  }
+  if (norm == 0.0)
+    return;
+  scale = -body->pressure * error / norm;
+
+  memcpy(first, body->points[body->outline[0]], sizeof(vec2));
+  memcpy(last, body->points[body->outline[n - 1]], sizeof(vec2));
+  for (i = 0; i < n; i++) {
+    float* point = body->points[body->outline[i]];
+    float* next = (i == n - 1)? first : body->points[body->outline[i + 1]];
+    grad[0] = 0.5f * (next[1] - last[1]);
+    grad[1] = 0.5f * (last[0] - next[0]);
+    memcpy(last, point, sizeof(vec2));
+    point[0] += scale * grad[0];
+    point[1] += scale * grad[1];
+  }
+}
+
+// fit the rest shape to the points by the rotation that best lines
+// them up, found from sums rather than trig, then pull toward it
+static void do_shape_match(World* world, Body* body) {
+  float dot = 0.0, cross = 0.0, len, c, s;
+  vec2 center;
+  int i;
+
+  points_center(body->points, body->num_points, center);
+  for (i = 0; i < body->num_points; i++) {
+    float x = body->points[i][0] - center[0];
+    float y = body->points[i][1] - center[1];
+    dot += body->rest_shape[i][0] * x + body->rest_shape[i][1] * y;
+    cross += body->rest_shape[i][0] * y - body->rest_shape[i][1] * x;
+  }
+  if (dot == 0.0 && cross == 0.0)
+    return;
+  len = world->deterministic? rsqrt(dot*dot + cross*cross)
+    : 1.0 / sqrt(dot*dot + cross*cross);
+  c = dot * len;
+  s = cross * len;
+
+  for (i = 0; i < body->num_points; i++) {
+    float* rest = body->rest_shape[i];
+    float gx = center[0] + rest[0] * c - rest[1] * s;
+    float gy = center[1] + rest[0] * s + rest[1] * c;
+    body->points[i][0] += body->shape_match * (gx - body->points[i][0]);
+    body->points[i][1] += body->shape_match * (gy - body->points[i][1]);
+  }
+}
+
 // pulls verts towards eachother to act as constraint
-void body_do_edges(Body* body) {
+void body_do_edges(World* world, Body* body) {
   int i;
+  if (body->rigid || body->type == BODY_STATIC)
+    return;
 
+  world->stats.iterations++;
   for (i = 0; i < body->num_edges; i++) {
     Edge* edge = &body->edges[i];
     
     float dx = (*edge->point1)[0] - (*edge->point2)[0];
     float dy = (*edge->point1)[1] - (*edge->point2)[1];
-    float d = sqrt(dx*dx + dy*dy);
+    float tx, ty;
 
-    float diff = 0.0;
-    if (d != 0.0) {
-      diff = (edge->length - d) / d;
-    }
+    if (world->deterministic) {
+      // all float, in the order the fleet's kernel uses
+      float diff = 0.5f * (edge->length * rsqrt(dx*dx + dy*dy) - 1.0f);
+      tx = dx * diff;
+      ty = dy * diff;
+    } else {
+      float d = sqrt(dx*dx + dy*dy);
 
-    float tx = dx * 0.5 * diff;
-    float ty = dy * 0.5 * diff;
+      float diff = 0.0;
+      if (d != 0.0) {
+        diff = (edge->length - d) / d;
+      }
+
+      tx = dx * 0.5 * diff;
+      ty = dy * 0.5 * diff;
+    }
 
     (*edge->point1)[0] += tx;
     (*edge->point1)[1] += ty;
@@ -139,34 +586,90 @@ void body_do_edges(Body* body) {
     (*edge->point2)[0] -= tx;
     (*edge->point2)[1] -= ty;
   }
+  if (body->pressure > 0.0)
+    do_pressure(body);
+  if (body->shape_match > 0.0)
+    do_shape_match(world, body);
 }
 
-// collision response of the last detected collision
-static void handle() {
-  vec2* point1 = handler.edge->point1;
-  vec2* point2 = handler.edge->point2;
+void body_contact_push(vec2 point1, vec2 point2, vec2 vertex,
+  float depth, vec2 normal, float edge_mass, BodyType edge_type,
+  float vertex_mass, BodyType vertex_type, vec2 push[3])
+{
   vec2 collision;
   float z, lambda, m, inv_m, r1, r2;
 
-  collision[0] = handler.normal[0] * handler.depth;
-  collision[1] = handler.normal[1] * handler.depth;
+  collision[0] = normal[0] * depth;
+  collision[1] = normal[1] * depth;
 
-  z = (fabs((*point1)[0] - (*point2)[0]) > fabs((*point1)[1] - (*point2)[1]))?
-    ((*handler.vertex)[0] - collision[0] - (*point1)[0]) / ((*point2)[0] - (*point1)[0])
-    : ((*handler.vertex)[1] - collision[1] - (*point1)[1]) / ((*point2)[1] - (*point1)[1]);
+  z = (fabs(point1[0] - point2[0]) > fabs(point1[1] - point2[1]))?
+    (vertex[0] - collision[0] - point1[0]) / (point2[0] - point1[0])
+    : (vertex[1] - collision[1] - point1[1]) / (point2[1] - point1[1]);
 
   lambda = 1.0/(z*z + (1 - z)*(1 - z));
-  m = z * handler.edge->parent->mass + (1.0 - z) * handler.edge->parent->mass;
-  inv_m = 1.0/(m + handler.parent->mass);
-  r1 = handler.parent->mass * inv_m;
+  m = z * edge_mass + (1.0 - z) * edge_mass;
+  inv_m = 1.0/(m + vertex_mass);
+  r1 = vertex_mass * inv_m;
   r2 = m * inv_m;
 
-  (*point1)[0] -= collision[0] * ((1 - z) * r1 * lambda);
-  (*point1)[1] -= collision[1] * ((1 - z) * r1 * lambda);
-  (*point2)[0] -= collision[0] * (z * r1 * lambda);
-  (*point2)[1] -= collision[1] * (z * r1 * lambda);
-  (*handler.vertex)[0] += collision[0] * r2;
-  (*handler.vertex)[1] += collision[1] * r2;
+  // static and kinematic bodies don't give way
+  if (edge_type != BODY_DYNAMIC) {
+    r1 = 0.0;
+    r2 = 1.0;
+  } else if (vertex_type != BODY_DYNAMIC) {
+    r1 = 1.0;
+    r2 = 0.0;
+  }
+
+  push[0][0] = -(collision[0] * ((1 - z) * r1 * lambda));
+  push[0][1] = -(collision[1] * ((1 - z) * r1 * lambda));
+  push[1][0] = -(collision[0] * (z * r1 * lambda));
+  push[1][1] = -(collision[1] * (z * r1 * lambda));
+  push[2][0] = collision[0] * r2;
+  push[2][1] = collision[1] * r2;
+}
+
+void body_apply_pushes(Body* body) {
+  int i;
+  for (i = 0; i < body->num_points; i++) {
+    body->points[i][0] += fixed_to_float(body->pushes[i][0]);
+    body->points[i][1] += fixed_to_float(body->pushes[i][1]);
+    body->pushes[i][0] = 0;
+    body->pushes[i][1] = 0;
+  }
+}
+
+// move a point, or hold the push back in fixed point so the pass's
+// result doesn't depend on the order pairs come in
+static void push_point(World* world, Body* body, vec2* point, vec2 push) {
+  if (world->deterministic) {
+    vec2x* pushes = &body->pushes[point - body->points];
+    (*pushes)[0] += fixed_from_float(push[0]);
+    (*pushes)[1] += fixed_from_float(push[1]);
+  } else {
+    (*point)[0] += push[0];
+    (*point)[1] += push[1];
+  }
+}
+
+// collision response of the last detected collision
+static void handle(World* world) {
+  Contact* contact = &world->contact;
+  Body* edge_body = contact->edge->parent;
+  vec2 push[3];
+
+  world->stats.contacts++;
+  body_contact_push(*contact->edge->point1, *contact->edge->point2,
+    *contact->vertex, contact->depth, contact->normal,
+    edge_body->mass, edge_body->type,
+    contact->parent->mass, contact->parent->type, push);
+
+  push_point(world, edge_body, contact->edge->point1, push[0]);
+  push_point(world, edge_body, contact->edge->point2, push[1]);
+  push_point(world, contact->parent, contact->vertex, push[2]);
+
+  edge_body->points_touched = true;
+  contact->parent->points_touched = true;
 }
 
 // return interval distance between 2 ranges
@@ -175,22 +678,27 @@ static float interv_dist(vec2* range1, vec2* range2) {
     (*range2)[0] - (*range1)[1] : (*range1)[0] - (*range2)[1];
 }
 
-// exactly what is sounds like. Used for AABB
-static void project_to_axis(Body* body, vec2* axis, vec2* range) {
-  float dot = (*axis)[0] * body->points[0][0] + (*axis)[1] * body->points[0][1];
+void body_project(Body* body, vec2 axis, vec2 range) {
+  float dot = axis[0] * body->points[0][0] + axis[1] * body->points[0][1];
   int i;
-  (*range)[0] = dot;
-  (*range)[1] = dot;
+  range[0] = dot;
+  range[1] = dot;
 
   for (i = 0; i < body->num_points; i++) {
-    dot = (*axis)[0] * body->points[i][0] + (*axis)[1] * body->points[i][1];
-    (*range)[0] = min((*range)[0], dot);
-    (*range)[1] = max((*range)[1], dot);
+    dot = axis[0] * body->points[i][0] + axis[1] * body->points[i][1];
+    range[0] = min(range[0], dot);
+    range[1] = max(range[1], dot);
   }
 }
 
+// exactly what is sounds like. Used for AABB
+static void project_to_axis(Body* body, vec2* axis, vec2* range) {
+  body_project(body, *axis, *range);
+}
+
 // AABB collision
-static bool bodies_colliding(Body* body1, Body* body2) {
+static bool bodies_colliding(World* world, Body* body1, Body* body2) {
+  Contact* contact = &world->contact;
   float min_dist, small_dist;
   int i;
   float dist, len, xx, yy, dot;
@@ -207,7 +715,8 @@ static bool bodies_colliding(Body* body1, Body* body2) {
     axis[1] = (*edge->point1)[0] - (*edge->point2)[0];
 
     // normalize
-    len = 1.0/sqrt(axis[0]*axis[0] + axis[1]*axis[1]);
+    len = world->deterministic? rsqrt(axis[0]*axis[0] + axis[1]*axis[1])
+      : 1.0/sqrt(axis[0]*axis[0] + axis[1]*axis[1]);
     axis[0] *= len;
     axis[1] *= len;
 
@@ -219,14 +728,14 @@ static bool bodies_colliding(Body* body1, Body* body2) {
       return false;
     else if (fabs(dist) < min_dist) {
       min_dist = fabs(dist);
-      handler.normal[0] = axis[0];
-      handler.normal[1] = axis[1];
-      handler.edge = edge;
+      contact->normal[0] = axis[0];
+      contact->normal[1] = axis[1];
+      contact->edge = edge;
     }
   }
 
-  handler.depth = min_dist;
-  if (handler.edge->parent != body2) {
+  contact->depth = min_dist;
+  if (contact->edge->parent != body2) {
     // swap the bodies... its easier
     temp = body1;
     body1 = body2;
@@ -235,21 +744,21 @@ static bool bodies_colliding(Body* body1, Body* body2) {
 
   xx = body1->center_of_mass[0] - body2->center_of_mass[0];
   yy = body1->center_of_mass[1] - body2->center_of_mass[1];
-  dot = handler.normal[0] * xx + handler.normal[1] * yy;
+  dot = contact->normal[0] * xx + contact->normal[1] * yy;
   if (dot < 0.0) {
-    handler.normal[0] = -handler.normal[0];
-    handler.normal[1] = -handler.normal[1];
+    contact->normal[0] = -contact->normal[0];
+    contact->normal[1] = -contact->normal[1];
   }
 
   small_dist = 10000.0;
   for (i = 0; i < body1->num_points; i++) {
     xx = body1->points[i][0] - body2->center_of_mass[0];
     yy = body1->points[i][1] - body2->center_of_mass[1];
-    dot = handler.normal[0] * xx + handler.normal[1] * yy;
+    dot = contact->normal[0] * xx + contact->normal[1] * yy;
     if (dot < small_dist) {
       small_dist = dot;
-      handler.vertex = &body1->points[i];
-      handler.parent = body1;
+      contact->vertex = &body1->points[i];
+      contact->parent = body1;
     }
   }
 
@@ -276,63 +785,155 @@ static bool test_callbacks1(void* vcb, void* vother) {
   return false;
 }
 
-static bool do_bodies(void* vbody1, void* vbody2) {
-  Body *body1 = vbody1, *body2 = vbody2;
-  if (body1 != body2) {
-    if (body1->mask & body2->mask) {
-      if (bodies_overlapping(body1, body2)) {
-        if (bodies_colliding(body1, body2)) {
-          list_traverse(body1->collision_callbacks, test_callbacks1, body2);
-          handle();
-        }
+static void do_pair(World* world, Body* body1, Body* body2) {
+  world->stats.pairs++;
+  if (body1->mask & body2->mask) {
+    if (bodies_overlapping(body1, body2)) {
+      if (bodies_colliding(world, body1, body2)) {
+        world->stats.hits++;
+        // anything touching gets full detail for a while
+        body_wake(body1);
+        body_wake(body2);
+        list_traverse(body1->collision_callbacks, test_callbacks1, body2);
+        list_traverse(body2->collision_callbacks, test_callbacks1, body1);
+        handle(world);
       }
     }
   }
+}
+
+static bool do_static_pair(Body* other, void* vbody) {
+  Body* body = vbody;
+  do_pair(body->world, body, other);
   return false;
 }
 
-static bool do_bodies_bodies(void* body, void* data) {
-  list_traverse(bodies, do_bodies, body);
+// dynamic pairs are handled from the body created first. Candidates
+// are gathered before any pair is handled, since a collision callback
+// may change the tree.
+static bool gather_moving(Body* other, void* vbody) {
+  Body* body = vbody;
+  World* world = body->world;
+  if (other->type == BODY_KINEMATIC
+    || (other->type == BODY_DYNAMIC && other->id > body->id)) {
+    if (world->num_candidates == world->candidate_capacity) {
+      world->candidate_capacity = (world->candidate_capacity > 0)?
+        world->candidate_capacity * 2 : 16;
+      world->candidates = mem_realloc(MEM_WORLDS, world->candidates,
+        sizeof(Body*) * world->candidate_capacity);
+    }
+    world->candidates[world->num_candidates++] = other;
+  }
   return false;
 }
 
-void body_do_collisions(Body* body) {
-  // Just do a pretty cheap n*n-body test
-  list_traverse(bodies, do_bodies_bodies, NULL);
+static bool collect_static(void* vbody, void* vworld) {
+  Body* body = vbody;
+  World* world = vworld;
+  if (body->type == BODY_STATIC)
+    world->static_bodies[world->static_capacity++] = body;
+  return false;
 }
 
-void body_do_center(Body* body) {
+// the static hierarchy is only rebuilt when static bodies change
+static void update_static_tree(World* world) {
+  if (world->static_dirty == false)
+    return;
+
+  // static_capacity counts the bodies while collecting
+  world->static_bodies = mem_realloc(MEM_WORLDS, world->static_bodies,
+    sizeof(Body*) * world->bodies->length);
+  world->static_capacity = 0;
+  list_traverse(world->bodies, collect_static, world);
+  bvh_build(world->static_tree, world->static_bodies, world->static_capacity);
+  world->static_dirty = false;
+}
+
+void body_do_collisions(World* world, Body* body) {
   int i;
-  body->center_of_mass[0] = 0.0;
-  body->center_of_mass[1] = 0.0;
+  if (body->type != BODY_DYNAMIC)
+    return;
 
-  body->bbox[0] = 10000.0f;
-  body->bbox[1] = 10000.0f;
-  body->bbox[2] = -10000.0f;
-  body->bbox[3] = -10000.0f;
+  update_static_tree(world);
+  bvh_query(world->static_tree, body->bbox, do_static_pair, body);
 
-  for (i = 0; i < body->num_points; i++) {
-    body->center_of_mass[0] += body->points[i][0];
-    body->center_of_mass[1] += body->points[i][1];
+  world->num_candidates = 0;
+  tree_query(world->dynamic_tree, body->bbox, gather_moving, body);
+  for (i = 0; i < world->num_candidates; i++)
+    do_pair(world, body, world->candidates[i]);
+}
 
-    body->bbox[0] = min(body->bbox[0], body->points[i][0]);
-    body->bbox[1] = min(body->bbox[1], body->points[i][1]);
-    body->bbox[2] = max(body->bbox[2], body->points[i][0]);
-    body->bbox[3] = max(body->bbox[3], body->points[i][1]);
-  }
+typedef struct BroadphaseVisit {
+  bool (*fn)(Body*, void*);
+  void* data;
+  bool done; // fn asked to stop
+} BroadphaseVisit;
 
-  body->center_of_mass[0] /= body->num_points;
-  body->center_of_mass[1] /= body->num_points;
+static bool visit_region(Body* body, void* vvisit) {
+  BroadphaseVisit* visit = vvisit;
+  visit->done = visit->fn(body, visit->data);
+  return visit->done;
 }
 
+// visit every body along the whole segment, never clipping it
+static float visit_ray(Body* body, float max_fraction, void* vvisit) {
+  BroadphaseVisit* visit = vvisit;
+  visit->done = visit->fn(body, visit->data);
+  return visit->done? 0.0 : max_fraction;
+}
+
+void body_broadphase_region(World* world, vec4 bbox,
+  bool (*fn)(Body*, void*), void* data)
+{
+  BroadphaseVisit visit = {fn, data, false};
+  update_static_tree(world);
+  bvh_query(world->static_tree, bbox, visit_region, &visit);
+  if (visit.done == false)
+    tree_query(world->dynamic_tree, bbox, visit_region, &visit);
+}
+
+void body_broadphase_ray(World* world, vec2 from, vec2 to,
+  bool (*fn)(Body*, void*), void* data)
+{
+  BroadphaseVisit visit = {fn, data, false};
+  update_static_tree(world);
+  bvh_raycast(world->static_tree, from, to, visit_ray, &visit);
+  if (visit.done == false)
+    tree_raycast(world->dynamic_tree, from, to, visit_ray, &visit);
+}
+
+void body_do_center(World* world, Body* body) {
+  body_sync_points(body);
+  update_bounds(body);
+
+  // moving bodies only touch the tree once they leave their fat bbox
+  if (world == NULL || body->type == BODY_STATIC)
+    return;
+  if (body->proxy < 0)
+    body->proxy = tree_insert(world->dynamic_tree, body);
+  else
+    tree_move(world->dynamic_tree, body->proxy);
+}
+
+
 void body_do_render(Body* body) {
+  body_sync_points(body);
+  if (body->vbo == 0) {
+    glGenBuffers(1, &body->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, body->vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+      (sizeof(vec2) + sizeof(vec3)) * body->num_points, NULL, GL_DYNAMIC_DRAW);
+    mem_track(MEM_GPU, (sizeof(vec2) + sizeof(vec3)) * body->num_points);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec2) * body->num_points,
+      sizeof(vec3) * body->num_points, body->colors);
+  }
   glBindBuffer(GL_ARRAY_BUFFER, body->vbo);
   glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec2) * body->num_points,
     body->points);
-  glVertexAttribPointer(body_program->attribute[0], 2, GL_FLOAT, false,
-    0, (void*)(0));
-  glVertexAttribPointer(body_program->attribute[1], 3, GL_FLOAT, false,
-    0, (void*)(sizeof(vec2) * body->num_points));
+  glVertexAttribPointer(pipeline_attribute(body_program, "coord"), 2, GL_FLOAT,
+    false, 0, (void*)(0));
+  glVertexAttribPointer(pipeline_attribute(body_program, "color"), 3, GL_FLOAT,
+    false, 0, (void*)(sizeof(vec2) * body->num_points));
   if (body->wire == false)
     glDrawArrays(GL_TRIANGLE_STRIP, 0, body->num_points);
   else
@@ -345,7 +946,7 @@ void body_add_collision_callback(
   void (*callback)(Body*, Body*, void*),
   void* data)
 {
-  CollisionCallback* cb = malloc(sizeof(CollisionCallback));
+  CollisionCallback* cb = mem_alloc(MEM_CALLBACKS, sizeof(CollisionCallback));
   cb->body = body;
   cb->other = other;
   cb->callback = callback;
@@ -8,6 +8,46 @@
 #include "maths.h"
 #include "list.h"
 
+typedef struct World World;
+
+/**
+ * How a body takes part in the simulation
+ */
+typedef enum BodyType {
+
+  BODY_DYNAMIC,   // integrated and pushed around by collisions
+  BODY_KINEMATIC, // integrated without gravity, moved only by its logic
+  BODY_STATIC     // never moves, kept in the static hierarchy
+
+} BodyType;
+
+/**
+ * Simulation level of detail
+ */
+typedef enum BodyLod {
+
+  BODY_LOD_FULL,    // every constraint iteration
+  BODY_LOD_REDUCED, // one constraint iteration per frame
+  BODY_LOD_FROZEN   // switched to rigid mode until it wakes
+
+} BodyLod;
+
+/**
+ * Bodies within this distance of the view always simulate in full
+ */
+#define BODY_LOD_MARGIN 200.0
+
+/**
+ * Bodies stretched less than this fraction of their rest lengths
+ * may be frozen when they are far from the view
+ */
+#define BODY_LOD_FREEZE 0.02
+
+/**
+ * Frames a body simulates in full after touching another
+ */
+#define BODY_LOD_HOLD 30
+
 typedef struct Edge {
 
   vec2* point1;
@@ -17,17 +57,36 @@ typedef struct Edge {
 
 } Edge;
 
+/**
+ * A vertex of one body pushed into an edge of another
+ */
+typedef struct Contact {
+
+  float depth;
+  vec2 normal;
+  Edge* edge;
+  vec2* vertex;
+  struct Body* parent; // the vertex's body
+
+} Contact;
+
 typedef struct Body {
 
+  World* world; // the world it was added to, or NULL
+  int id;       // order added to its world, used to order pairs
+  BodyType type;
+  int proxy; // leaf in the dynamic tree, -1 while out of it
+
   // Collision infos
   vec2 center_of_mass;
   float mass;
   vec4 bbox; // = {minX minY maxX maxY}
 
-  vec2* points;
+  vec2* points;      // in its world's point pool once added
   vec2* last_points;
   vec3* colors;
   int num_points;
+  int first_point;   // index in the world's point pool, -1 before
 
   Edge* edges;
   int num_edges;
@@ -43,6 +102,34 @@ typedef struct Body {
   bool boxed;   // whether to constrain to the world
   bool wire;    // display as wireframe
 
+  BodyLod lod;  // how much simulation the body gets
+  int lod_hold; // frames left at full detail after a contact
+  int num_joints; // joints holding it, which keep it at full detail
+
+  // Rigid mode. The shape is kept about the center of mass and points
+  // are only brought up to date when something reads them.
+  bool rigid;
+  vec2 position;          // center of mass
+  float angle;
+  vec2 velocity;          // per step
+  float angular_velocity; // per step
+  vec2* local_points;     // shape at angle 0
+  bool points_dirty;      // points lag position and angle
+  bool points_touched;    // points were pushed by a collision
+
+  // contact pushes a deterministic collision pass holds back until
+  // every pair is done, per point
+  vec2x* pushes;
+
+  // Shape keeping that costs O(points) rather than bracing edges. Both
+  // run after each pass of the edge constraints.
+  float pressure;    // stiffness of the area constraint, 0 for none
+  float rest_area;   // area inside the outline at rest
+  float shape_match; // pull toward the best fit of the rest shape,
+                     // 0 for none
+  int* outline;      // point indices in order around the body
+  vec2* rest_shape;  // rest pose about its center
+
 } Body;
 
 /**
@@ -61,40 +148,190 @@ Body* body_new(
   vec2i* edges,
   int num_edges);
 
+/**
+ * Free a body, its edges, collision callbacks and vertex buffer. Its
+ * colors are borrowed and stay. A body in a world is freed along with
+ * the world by world_free; freeing it alone leaves the world pointing
+ * at it, and its pooled points stay in the world's pool.
+ * @param body a body
+ */
+void body_free(Body* body);
+
+/**
+ * Move a body's points to new storage that holds the same values,
+ * as when its world's point pool grows. Edges, and the world's
+ * contact if it is the body's, follow. The old storage is not freed.
+ * @param body        a body
+ * @param points      new points
+ * @param last_points new last points
+ */
+void body_move_points(Body* body, vec2* points, vec2* last_points);
+
 /**
  * Do a single timestep of verlet integration on a body
+ * @param world the body's world
+ * @param body  a body
+ * @param dt    time since last frame in seconds
+ */
+void body_do_verlet(World* world, Body* body, double dt);
+
+/**
+ * Change the type of a body. Making a body static, or static bodies
+ * anything else, rebuilds the static hierarchy before the next
+ * collision pass. Move a static body by making it dynamic first.
+ * Bodies that aren't static join the dynamic tree on their next
+ * body_do_center.
  * @param body a body
- * @param dt   time since last frame in seconds
+ * @param type the new type
  */
-void body_do_verlet(Body* body, double dt);
+void body_set_type(Body* body, BodyType type);
 
 /**
- * Execute step callback on a body
+ * Switch a body between soft and rigid simulation. A rigid body
+ * keeps the shape it has when switched, integrates only its position
+ * and angle, and skips edge constraints. Its velocity carries over
+ * both ways. Don't write the points of a rigid body directly.
+ * @param body  a body
+ * @param rigid true for rigid, false for soft
+ */
+void body_set_rigid(Body* body, bool rigid);
+
+/**
+ * Keep a body's area near its rest area, as a gas inside it would.
+ * The rest area and shape are captured from the points the first time
+ * this or body_set_shape_match is called, and kept after, so calling
+ * either again only changes the stiffness. Its outline is its points
+ * in order of angle about their center, so the body should be about
+ * star shaped. A ring of perimeter edges and some pressure hold a
+ * round body up without cross bracing.
+ * @param body      a body
+ * @param stiffness fraction of the area error fixed each pass, 0 to
+ *                  turn it off
+ */
+void body_set_pressure(Body* body, float stiffness);
+
+/**
+ * Pull a body's points toward its rest shape, moved and turned to fit
+ * wherever the points are. The rest shape is captured once, as with
+ * body_set_pressure. Unlike rigid mode the body still bends and
+ * squashes, it just springs back.
+ * @param body      a body
+ * @param stiffness fraction of the way to the fitted shape points
+ *                  move each pass, 0 to turn it off
+ */
+void body_set_shape_match(Body* body, float stiffness);
+
+/**
+ * Bring the points of a rigid body up to date with its position and
+ * angle, first taking in any pushes collisions gave them.
+ * Soft bodies are left alone.
  * @param body a body
- * @param dt   time since last frame in seconds
  */
-void body_do_step(Body* body, double dt);
+void body_sync_points(Body* body);
+
+/**
+ * Pick the level of detail of a body from how far it is from the
+ * world's view, how deformed it is, and whether it touched something
+ * lately
+ * @param world the body's world
+ * @param body  a body
+ */
+void body_do_lod(World* world, Body* body);
+
+/**
+ * Execute step callback on a body
+ * @param world the body's world
+ * @param body  a body
+ * @param dt    time since last frame in seconds
+ */
+void body_do_step(World* world, Body* body, double dt);
 
 /**
  * Calculate edge constraints on a body
- * @param body a body
+ * @param world the body's world
+ * @param body  a body
  */
-void body_do_edges(Body* body);
+void body_do_edges(World* world, Body* body);
 
 /**
- * Calculate collision constraints on a body
- * @param body a body
+ * Work out how a contact moves the three points in it. Every solver
+ * resolves contacts through this, so they agree to the bit.
+ * @param point1      first point of the edge
+ * @param point2      second point of the edge
+ * @param vertex      the point pushed into the edge
+ * @param depth       how far the vertex is in
+ * @param normal      unit normal, pointing from the edge's body to the
+ *                    vertex's
+ * @param edge_mass   mass of the edge's body
+ * @param edge_type   type of the edge's body
+ * @param vertex_mass mass of the vertex's body
+ * @param vertex_type type of the vertex's body
+ * @param push        set to the moves of point1, point2 and vertex
  */
-void body_do_collisions(Body* body);
+void body_contact_push(vec2 point1, vec2 point2, vec2 vertex,
+  float depth, vec2 normal, float edge_mass, BodyType edge_type,
+  float vertex_mass, BodyType vertex_type, vec2 push[3]);
 
 /**
- * Calculate center of mass on a body
+ * Project every point of a body onto an axis
+ * @param body  a body
+ * @param axis  a unit axis
+ * @param range set to {min max}
+ */
+void body_project(Body* body, vec2 axis, vec2 range);
+
+/**
+ * Move a body's points by the pushes a deterministic collision pass
+ * held back, and clear them
  * @param body a body
  */
-void body_do_center(Body* body);
+void body_apply_pushes(Body* body);
+
+/**
+ * Calculate collision constraints between a body and every body it
+ * can push or be pushed by. Each pair is handled once, from its
+ * dynamic body, and pairs of static or kinematic bodies never are.
+ * Candidates come from the static hierarchy and the dynamic tree.
+ * @param world the body's world
+ * @param body  a body
+ */
+void body_do_collisions(World* world, Body* body);
+
+/**
+ * Visit every body whose bbox may overlap a region, static or not.
+ * Bodies may be visited whose bbox only comes near the region.
+ * @param world a world
+ * @param bbox  the region = {minX minY maxX maxY}
+ * @param fn    a function to apply. Its first argument is the body,
+ *              the second is extra data. If it ever returns true the
+ *              search ends. It must not add, move or remove bodies.
+ * @param data  extra data to pass to the function
+ */
+void body_broadphase_region(World* world, vec4 bbox,
+  bool (*fn)(Body*, void*), void* data);
+
+/**
+ * Visit every body whose bbox may cross a segment, static or not.
+ * @param world a world
+ * @param from  start of the segment
+ * @param to    end of the segment
+ * @param fn    as for body_broadphase_region
+ * @param data  extra data to pass to the function
+ */
+void body_broadphase_ray(World* world, vec2 from, vec2 to,
+  bool (*fn)(Body*, void*), void* data);
+
+/**
+ * Calculate center of mass and bbox on a body, and keep its leaf in
+ * the dynamic tree up to date
+ * @param world the body's world, or NULL if it has none yet
+ * @param body  a body
+ */
+void body_do_center(World* world, Body* body);
 
 /**
- * Render a body
+ * Render a body. Its buffer is created on first render, so bodies
+ * that are never drawn never touch GL.
  * @param body a body
  */
 void body_do_render(Body* body);
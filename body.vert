@@ -1,10 +1,16 @@
-#version 130
+#version 140
+
+// maps world coordinates to clip space
+layout(std140) uniform View {
+  vec2 scale;
+  vec2 offset;
+};
 
 in vec2 coord;
 in vec3 color;
 out vec4 frag_color;
 
 void main() {
-  gl_Position = vec4((coord.x / 400.0) - 1.0, (coord.y / 300.0) - 1.0, 1.0, 1.0);
+  gl_Position = vec4(coord * scale + offset, 1.0, 1.0);
   frag_color = vec4(color, 1.0);
 }
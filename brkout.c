@@ -1,71 +1,96 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include "game.h"
+#include "batch.h"
+#include "fleet.h"
+#include "mem.h"
+#include "metrics.h"
+#include "net.h"
+#include "snapshot.h"
+#include "scene.h"
 
-static int broken = 0;       // how many broken bricks
-static int score = 10000;    // score, it goes down as time passes
-static float response = 30.0;// amount of force the paddle applies
-static Body* bricks[8];      // bricks
+// the part of a game a network rollback puts back with the world
+typedef struct BreakoutState {
+  int broken;         // how many broken bricks
+  int score;          // score, it goes down as time passes
+  int rounds;         // times every brick was broken
+  float response;     // amount of force the paddle applies
+  unsigned seed;      // for rand_r, so games on other threads don't share
+} BreakoutState;
 
-/**
- * prototype for paddle
- */
-static vec2 paddle_points[8] = {
- {0.0, 16+0.0},
- {0.0, 16+32.0},
- {32.0, 16+0.0},
- {32.0, 16+32.0},
- {64.0, 16+0.0},
- {64.0, 16+32.0},
- {96.0, 16+0.0},
- {96.0, 16+32.0},
-};
-
-static vec2i paddle_edges[10] = {
-  {0, 1},
-  {1, 3},
-  {3, 5},
-  {5, 7},
-  {7, 6},
-  {6, 4},
-  {4, 2},
-  {2, 0},
-  {0, 7},
-  {1, 6},
-};
-
-static vec3 paddle_colors[8] = {
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
- {1.0, 0.0, 0.0},
-};
+// one game of breakout, passed to its callbacks
+typedef struct Breakout {
+  World* world;
+  Scene* scene;       // everything in the level
+  Instance* ball;     // the ball's spawn point
+  Body* paddles[NET_PLAYERS]; // a second paddle if the level has one
+  int num_paddles;
+  Instance** bricks;  // bricks
+  int num_bricks;
+  BreakoutState state;
+  bool headless;      // no window
+  bool autopilot;     // the paddles steer themselves
+  bool net;           // played over the network, no checkpoints
+  Particles* particles; // debris from broken bricks, NULL for none
+} Breakout;
+
+// paddle points pushed by the arrow keys
+static const int paddle_points[] = {0, 1, 7, 6};
+
+// without a player, get under the ball and swat it when it comes down
+static void autopilot(float dx, float dy, bool* up, bool* right, bool* left) {
+  *right = dx > 8.0;
+  *left = dx < -8.0;
+  *up = dy < 40.0 && dx > -30.0 && dx < 30.0;
+}
+
+// a restored checkpoint brings its own bricks back, so count again the
+// ones broken in it, or the round could never end
+static void count_broken(Breakout* game) {
+  int i;
+  game->state.broken = 0;
+  for (i = 0; i < game->num_bricks; i++) {
+    if (game->bricks[i]->body->type != BODY_STATIC)
+      game->state.broken++;
+  }
+}
 
 static void paddle_logic(Body* paddle, double dt, void* data) {
+  Breakout* game = data;
+  World* world = paddle->world;
+  const int* keys = net_keys[(paddle == game->paddles[0])? 0 : 1];
+  bool up = world->key_held[keys[0]];
+  bool down = world->key_held[keys[1]];
+  bool left = world->key_held[keys[2]];
+  bool right = world->key_held[keys[3]];
+
+  if (game->autopilot) {
+    Body* ball = game->ball->body;
+    autopilot(ball->center_of_mass[0] - paddle->center_of_mass[0],
+      ball->center_of_mass[1] - paddle->center_of_mass[1],
+      &up, &right, &left);
+  }
 
-  if (GAME_KEY_HELD[GLUT_KEY_UP]) {
+  if (up) {
     paddle->points[0][1] += 1.5;
     paddle->points[1][1] += 1.5;
     paddle->points[7][1] += 1.5;
     paddle->points[6][1] += 1.5;
-  } else if (GAME_KEY_HELD[GLUT_KEY_DOWN]) {
+  } else if (down) {
     paddle->points[0][1] -= 0.5;
     paddle->points[1][1] -= 0.5;
     paddle->points[7][1] -= 0.5;
     paddle->points[6][1] -= 0.5;
   }
 
-  if (GAME_KEY_HELD[GLUT_KEY_RIGHT]) {
+  if (right) {
     paddle->points[0][0] += 0.5;
     paddle->points[1][0] += 0.5;
     paddle->points[7][0] += 0.5;
     paddle->points[6][0] += 0.5;
-  } else if (GAME_KEY_HELD[GLUT_KEY_LEFT]) {
+  } else if (left) {
     paddle->points[0][0] -= 0.5;
     paddle->points[1][0] -= 0.5;
     paddle->points[7][0] -= 0.5;
@@ -77,53 +102,49 @@ static void paddle_logic(Body* paddle, double dt, void* data) {
   for (i = 0; i < paddle->num_points; i++) {
     paddle->points[i][1] = max(paddle->points[i][1], 16.0);
   }
+
+  if (game->headless || paddle != game->paddles[0])
+    return;
+
+  // presses are used up, so a tick stepped again by a rollback
+  // doesn't see them twice
+  if (world->key_pressed['m'] || world->key_pressed['M'])
+    metrics_set_overlay(metrics_overlay() == false);
+  world->key_pressed['m'] = world->key_pressed['M'] = false;
+
+  // checkpoint the whole world. Over the network it would only
+  // change one side.
+  if (game->net == false) {
+    if (world->key_pressed['s'] || world->key_pressed['S'])
+      snapshot_save(world, "brkout.snap");
+    else if ((world->key_pressed['l'] || world->key_pressed['L'])
+      && snapshot_restore(world, "brkout.snap"))
+      count_broken(game);
+    world->key_pressed['s'] = world->key_pressed['S'] = false;
+    world->key_pressed['l'] = world->key_pressed['L'] = false;
+  }
+
+  // scroll with the paddle when the level is wider than the window
+  if (game->scene->bounds[0] > 800.0) {
+    game_set_camera(
+      clamp(paddle->center_of_mass[0], 400.0, game->scene->bounds[0] - 400.0),
+      300.0, 1.0);
+  }
 }
 
-/**
- * Prototype for ball
- */
-static vec2 ball_points[5] = {
- {400+1.0, 400+13.0},
- {400+7.0, 400+29.0},
- {400+15.0, 400+1.0},
- {400+24.0, 400+29.0},
- {400+30.0, 400+13.0},
-};
-
-static vec2i ball_edges[10] = {
- {0, 1},
- {1, 3},
- {3, 4},
- {4, 2},
- {2, 0},
- {1, 2},
- {2, 3},
- {0, 4},
- {4, 1},
- {3, 0},
-};
-
-static vec3 ball_colors[5] = {
- {0.0, 0.0, 1.0},
- {0.0, 0.0, 1.0},
- {0.0, 0.0, 1.0},
- {0.0, 0.0, 1.0},
- {0.0, 0.0, 1.0},
-};
-
-static void ball_logic(Body* ball, double dt, void* data) {
+static void ball_logic(Body* body, double dt, void* data) {
+  Breakout* game = data;
   int i, j;
-  for (i = 0; i < ball->num_points; i++) {
-    if (ball->points[i][1] < 2) {
-      memcpy(ball->points, ball_points, sizeof(vec2) * ball->num_points);
-      memcpy(ball->last_points, ball_points, sizeof(vec2) * ball->num_points);
-      for (j = 0; j < ball->num_points; j++)
-        ball->points[j][0] += (rand() % 10+1)-5;
+  for (i = 0; i < body->num_points; i++) {
+    if (body->points[i][1] < 2) {
+      scene_place(game->scene, game->ball);
+      for (j = 0; j < body->num_points; j++)
+        body->points[j][0] += (rand_r(&game->state.seed) % 10+1)-5;
       break;
     }
   }
-  if (broken < 7) {
-    score -= 1;
+  if (game->state.broken < game->num_bricks) {
+    game->state.score -= 1;
   }
 }
 
@@ -131,96 +152,536 @@ static void ball_logic(Body* ball, double dt, void* data) {
  * Collision callback for ball
  */
 static void ball_extra_bounce(Body* paddle, Body* ball, void* data) {
+  Breakout* game = data;
   int i;
   for (i = 0; i < ball->num_points; i++) {
-    ball->points[i][1] += response;
+    ball->points[i][1] += game->state.response;
   }
 }
 
-/**
- * Prototype for brick
- */
-static vec3 brick_colors[8] = {
- {1.0, 1.0, 1.0},
- {0.0, 0.0, 0.0},
- {1.0, 1.0, 1.0},
- {0.0, 0.0, 0.0},
- {1.0, 1.0, 1.0},
- {0.0, 0.0, 0.0},
- {1.0, 1.0, 1.0},
- {0.0, 0.0, 0.0},
-};
+// shower a broken brick's color along the way the ball was going
+static void brick_debris(Breakout* game, Body* brick, Body* ball) {
+  vec2 velocity = {0.0, 0.0};
+  int i;
+  for (i = 0; i < ball->num_points; i++) {
+    velocity[0] += ball->points[i][0] - ball->last_points[i][0];
+    velocity[1] += ball->points[i][1] - ball->last_points[i][1];
+  }
+  velocity[0] *= 0.5 / ball->num_points;
+  velocity[1] *= 0.5 / ball->num_points;
+  particles_burst(game->particles, brick->bbox, velocity, 2.0,
+    brick->colors[0], 200);
+}
 
 /**
  * Collision callback for brick
  */
 static void brick_hit(Body* brick, Body* ball, void* data) {
-  int i, j;
-  if (brick->gravity == false) {
-    broken++;
+  Breakout* game = data;
+  BreakoutState* state = &game->state;
+  int i;
+  if (brick->type == BODY_STATIC) {
+    state->broken++;
+    if (game->particles != NULL)
+      brick_debris(game, brick, ball);
+    body_set_type(brick, BODY_DYNAMIC);
     brick->gravity = true;
     brick->wire = true;
     // if all bricks broken
-    if (broken == 7) {
-      broken = 0;
+    if (state->broken == game->num_bricks) {
+      state->broken = 0;
+      state->rounds++;
       // make game harder
-      response /= 2;
-      char buffer[256];
-      sprintf(buffer, "SCORE: %d", score);
-      score = 10000;
-      game_set_title((const char*) buffer);
+      state->response /= 2;
+      if (game->headless == false) {
+        char buffer[256];
+        sprintf(buffer, "SCORE: %d", state->score);
+        game_set_title((const char*) buffer);
+      }
+      state->score = 10000;
       // Reset bricks to initial position
-      for (i = 0; i < 7; i++) {
-        bricks[i]->gravity = false;
-        bricks[i]->wire = false;
-        bricks[i]->boxed = false;
-        memcpy(bricks[i]->points, paddle_points, sizeof(vec2) * bricks[i]->num_points);
-        memcpy(bricks[i]->last_points, paddle_points, sizeof(vec2) * bricks[i]->num_points);
-        for (j = 0; j < bricks[i]->num_points; j++) {
-          bricks[i]->last_points[j][0] += 48+100*i;
-          bricks[i]->points[j][0] += 48+100*i;
-          bricks[i]->last_points[j][1] += 500;
-          bricks[i]->points[j][1] += 500;
+      for (i = 0; i < game->num_bricks; i++)
+        scene_place(game->scene, game->bricks[i]);
+    }
+  }
+}
+
+// load a level into a world and hook up its callbacks
+static Breakout* breakout_new(World* world, const char* path, bool headless,
+  unsigned seed)
+{
+  Breakout* game = calloc(1, sizeof(Breakout));
+  Instance* paddle;
+  Instance* paddle2;
+  Scene* scene;
+  int i;
+
+  game->world = world;
+  game->state.score = 10000;
+  game->state.response = 30.0;
+  game->state.seed = seed;
+  game->headless = headless;
+  game->autopilot = headless;
+  game->scene = scene = scene_load(world, path);
+  if (scene == NULL) {
+    free(game);
+    return NULL;
+  }
+
+  game->ball = scene_instance(scene, "ball");
+  paddle = scene_instance(scene, "paddle");
+  paddle2 = scene_instance(scene, "paddle2");
+  if (paddle == NULL || game->ball == NULL) {
+    printf("%s needs a paddle and a ball\n", path);
+    scene_free(scene);
+    free(game);
+    return NULL;
+  }
+
+  game->paddles[game->num_paddles++] = paddle->body;
+  if (paddle2 != NULL)
+    game->paddles[game->num_paddles++] = paddle2->body;
+  for (i = 0; i < game->num_paddles; i++) {
+    body_add_collision_callback(game->paddles[i], game->ball->body,
+      ball_extra_bounce, game);
+    body_set_logic(game->paddles[i], paddle_logic, game);
+  }
+  body_set_logic(game->ball->body, ball_logic, game);
+
+  // every instance of the brick prototype is a brick
+  game->bricks = malloc(sizeof(Instance*) * scene->num_instances);
+  for (i = 0; i < scene->num_instances; i++) {
+    Instance* instance = &scene->instances[i];
+    if (strcmp(scene->protos[instance->proto].name, "brick") == 0) {
+      game->bricks[game->num_bricks++] = instance;
+      body_add_collision_callback(instance->body, game->ball->body,
+        brick_hit, game);
+    }
+  }
+  return game;
+}
+
+// free a game and its scene, after the world its bodies are in, as
+// they use the scene's colors
+static void breakout_free(Breakout* game) {
+  scene_free(game->scene);
+  free(game->bricks);
+  free(game);
+}
+
+// free a batch's worlds, then their games, which may be NULL past one
+// that failed to load
+static void free_batch(World** worlds, Breakout** games, int num_worlds) {
+  int i;
+  for (i = 0; i < num_worlds; i++) {
+    world_free(worlds[i]);
+    if (games[i] != NULL)
+      breakout_free(games[i]);
+  }
+  free(worlds);
+  free(games);
+}
+
+// step many headless games at once and report how fast they went
+static int run_batch(const char* path, int num_worlds, int ticks,
+  int threads, bool deterministic)
+{
+  World** worlds = malloc(sizeof(World*) * num_worlds);
+  Breakout** games = malloc(sizeof(Breakout*) * num_worlds);
+  struct timespec start, end;
+  double seconds;
+  unsigned checksum = 0;
+  int i, rounds = 0, broken = 0;
+
+  for (i = 0; i < num_worlds; i++) {
+    worlds[i] = world_new();
+    worlds[i]->deterministic = deterministic;
+    games[i] = breakout_new(worlds[i], path, true, i + 1);
+    if (games[i] == NULL) {
+      free_batch(worlds, games, i + 1);
+      return 1;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  batch_run(worlds, num_worlds, ticks, threads);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  for (i = 0; i < num_worlds; i++) {
+    rounds += games[i]->state.rounds;
+    broken += games[i]->state.rounds * games[i]->num_bricks
+      + games[i]->state.broken;
+    checksum = checksum * 16777619u ^ world_checksum(worlds[i]);
+  }
+  printf("%d worlds x %d ticks in %.3fs, %.0f ticks/s\n",
+    num_worlds, ticks, seconds, num_worlds * (double) ticks / seconds);
+  printf("%d bricks broken, %d rounds cleared\n", broken, rounds);
+  printf("checksum %08x\n", checksum);
+
+  free_batch(worlds, games, num_worlds);
+  return 0;
+}
+
+// step many headless games as one fleet, the game logic running over
+// its arrays between steps
+static int run_fleet(const char* path, int num_worlds, int ticks,
+  bool deterministic)
+{
+  World* world = world_new();
+  Breakout* game;
+  Fleet* fleet;
+  int n = num_worlds;
+  int ball, paddle, bounce, i, j, k, w, t, rounds = 0, broken = 0;
+  int* brick_bodies;
+  int* brick_pairs;
+  int* scores;
+  int* num_broken;
+  int* num_rounds;
+  float* responses;
+  unsigned* seeds;
+  float* observations;
+  struct timespec start, end;
+  double seconds;
+  unsigned checksum = 0;
+
+  world->deterministic = deterministic;
+  game = breakout_new(world, path, true, 1);
+  if (game == NULL) {
+    world_free(world);
+    return 1;
+  }
+  fleet = fleet_new(world, n);
+  ball = game->ball->body->id;
+  paddle = scene_instance(game->scene, "paddle")->body->id;
+  bounce = fleet_pair(fleet, paddle, ball);
+  brick_bodies = malloc(sizeof(int) * (game->num_bricks + 1));
+  brick_pairs = malloc(sizeof(int) * (game->num_bricks + 1));
+  for (i = 0; i < game->num_bricks; i++) {
+    brick_bodies[i] = game->bricks[i]->body->id;
+    brick_pairs[i] = fleet_pair(fleet, brick_bodies[i], ball);
+  }
+
+  scores = malloc(sizeof(int) * n);
+  num_broken = calloc(n, sizeof(int));
+  num_rounds = calloc(n, sizeof(int));
+  responses = malloc(sizeof(float) * n);
+  seeds = malloc(sizeof(unsigned) * n);
+  for (w = 0; w < n; w++) {
+    scores[w] = 10000;
+    responses[w] = 30.0;
+    seeds[w] = w + 1;
+  }
+
+  // ball then paddle center, per copy
+  observations = malloc(sizeof(float) * 4 * n);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (t = 0; t < ticks; t++) {
+    fleet_observe(fleet, (int[]) {ball, paddle}, 2, observations);
+
+    // paddle_logic and ball_logic
+    for (w = 0; w < n; w++) {
+      float* observation = &observations[w * 4];
+      bool up, right, left;
+      autopilot(observation[0] - observation[2],
+        observation[1] - observation[3], &up, &right, &left);
+      for (k = 0; k < 4; k++) {
+        i = fleet->first_point[paddle] + paddle_points[k];
+        fleet->x[i * n + w] += right? 0.5 : left? -0.5 : 0.0;
+        fleet->y[i * n + w] += up? 1.5 : 0.0;
+      }
+      for (i = fleet->first_point[paddle];
+        i < fleet->first_point[paddle] + fleet->body_points[paddle]; i++)
+        fleet->y[i * n + w] = max(fleet->y[i * n + w], 16.0);
+
+      for (i = fleet->first_point[ball];
+        i < fleet->first_point[ball] + fleet->body_points[ball]; i++) {
+        if (fleet->y[i * n + w] < 2) {
+          fleet_place(fleet, w, ball);
+          for (j = fleet->first_point[ball];
+            j < fleet->first_point[ball] + fleet->body_points[ball]; j++)
+            fleet->x[j * n + w] += (rand_r(&seeds[w]) % 10+1)-5;
+          break;
+        }
+      }
+      if (num_broken[w] < game->num_bricks)
+        scores[w] -= 1;
+    }
+
+    fleet_step(fleet);
+
+    // ball_extra_bounce and brick_hit
+    for (w = 0; w < n; w++) {
+      if (bounce >= 0 && fleet->touched[bounce * n + w]) {
+        for (i = fleet->first_point[ball];
+          i < fleet->first_point[ball] + fleet->body_points[ball]; i++)
+          fleet->y[i * n + w] += responses[w];
+      }
+      for (k = 0; k < game->num_bricks; k++) {
+        int brick = brick_bodies[k];
+        if (brick_pairs[k] < 0 || fleet->touched[brick_pairs[k] * n + w] == 0
+          || fleet->type[brick * n + w] != BODY_STATIC)
+          continue;
+        fleet->type[brick * n + w] = BODY_DYNAMIC;
+        if (++num_broken[w] == game->num_bricks) {
+          num_broken[w] = 0;
+          num_rounds[w]++;
+          responses[w] /= 2;
+          scores[w] = 10000;
+          for (i = 0; i < game->num_bricks; i++)
+            fleet_place(fleet, w, brick_bodies[i]);
         }
       }
     }
   }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  for (w = 0; w < n; w++) {
+    rounds += num_rounds[w];
+    broken += num_rounds[w] * game->num_bricks + num_broken[w];
+    checksum = checksum * 16777619u ^ fleet_checksum(fleet, w);
+  }
+  printf("%d worlds x %d ticks in %.3fs, %.0f world steps/s\n",
+    n, ticks, seconds, fleet->steps / seconds);
+  printf("%d bricks broken, %d rounds cleared\n", broken, rounds);
+  printf("checksum %08x\n", checksum);
+
+  fleet_free(fleet);
+  world_free(world);
+  breakout_free(game);
+  free(brick_bodies);
+  free(brick_pairs);
+  free(scores);
+  free(num_broken);
+  free(num_rounds);
+  free(responses);
+  free(seeds);
+  free(observations);
+  return 0;
+}
+
+// print how a network game went. Both sides print the same checksum
+// if they stepped the same world.
+static void net_report(Breakout* game, Net* net) {
+  NetStats* stats = &net->stats;
+  printf("%d bricks broken, %d rounds cleared\n",
+    game->state.rounds * game->num_bricks + game->state.broken,
+    game->state.rounds);
+  printf("%u ticks, %u stalls, %u packets sent, %u received\n",
+    stats->ticks, stats->stalls, stats->packets_sent,
+    stats->packets_received);
+  printf("%u rollbacks over %u ticks, %.3fms per tick, worst %.3fms\n",
+    stats->rollbacks, stats->rollback_ticks,
+    (stats->ticks > 0)? stats->rollback_time * 1e3 / stats->ticks : 0.0,
+    stats->rollback_worst * 1e3);
+  printf("checksum %08x\n", world_checksum(net->world));
+}
+
+// play one side of a two player game over UDP, in the game's window
+// once it is open. Given a number of ticks instead, it runs that many
+// without one, steering its paddle by autopilot through the network
+// input like a player would.
+static int run_net(const char* path, int player, int port,
+  const char* host, int peer_port, int delay, int ticks)
+{
+  struct timespec wait = {0, 500000};
+  World* world;
+  Breakout* game;
+  Net* net;
+  bool settled;
+
+  world = (ticks == 0)? game_world() : world_new();
+  game = breakout_new(world, path, ticks > 0, 1);
+  net = NULL;
+  if (game != NULL && game->num_paddles < NET_PLAYERS)
+    printf("%s needs a paddle2 for two players\n", path);
+  else if (game != NULL)
+    net = net_new(world, player, port, host, peer_port, delay);
+  if (net == NULL) {
+    if (ticks == 0)
+      game_free();
+    else
+      world_free(world);
+    if (game != NULL)
+      breakout_free(game);
+    return 1;
+  }
+  game->autopilot = false;
+  game->net = true;
+  net_set_state(net, &game->state, sizeof(BreakoutState));
+
+  if (ticks == 0) {
+    game_set_net(net);
+    game_run();
+    net_report(game, net);
+    net_free(net);
+    game_free();
+    breakout_free(game);
+    return 0;
+  }
+
+  while (net->tick < (unsigned) ticks) {
+    Body* paddle = game->paddles[player];
+    Body* ball = game->ball->body;
+    bool up, right, left;
+    autopilot(ball->center_of_mass[0] - paddle->center_of_mass[0],
+      ball->center_of_mass[1] - paddle->center_of_mass[1],
+      &up, &right, &left);
+    world->key_held[net_keys[player][0]] = up;
+    world->key_held[net_keys[player][2]] = left;
+    world->key_held[net_keys[player][3]] = right;
+    if (net_tick(net) == false)
+      nanosleep(&wait, NULL);
+  }
+  settled = net_settle(net, 5.0);
+  net_report(game, net);
+  net_free(net);
+  world_free(world);
+  breakout_free(game);
+  if (settled == false) {
+    printf("the peer's input never arrived\n");
+    return 1;
+  }
+  return 0;
 }
 
 int main(int argc, char** argv) {
-  int i, j;
-  srand(time(NULL));
-  game_init(&argc, argv, "jelly paddle");
+  const char* path = "brkout.scene";
+  int num_worlds = 0, ticks = 0, threads = 0, delay = 2;
+  const char* host = "127.0.0.1";
+  bool deterministic = false;
+  Breakout* game;
+  Scene* scene;
+  bool ok;
+  int i;
+
+  // jellypaddle --memory <any other arguments>
+  if (argc >= 2 && strcmp(argv[1], "--memory") == 0) {
+    atexit(mem_report);
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
 
-  Body* paddle = body_new(paddle_points, paddle_colors, 8, paddle_edges, 10);
-  Body* ball = body_new(ball_points, ball_colors, 5, ball_edges, 10);
-  body_add_collision_callback(paddle, ball, ball_extra_bounce, NULL);
-
-  body_set_logic(paddle, paddle_logic, NULL);
-  game_add_body(paddle);
-
-  ball->mask = 0xFFF;
-  body_set_logic(ball, ball_logic, NULL);
-  game_add_body(ball);
-
-  // Place bricks
-  for (i = 0; i < 7; i++) {
-    bricks[i] = body_new(paddle_points, brick_colors, 8, paddle_edges, 10);
-    body_add_collision_callback(bricks[i], ball, brick_hit, NULL);
-    bricks[i]->gravity = false;
-    bricks[i]->boxed = false;
-    bricks[i]->mass *= 2;
-    bricks[i]->mask = 0x02 << i;
-    for (j = 0; j < bricks[i]->num_points; j++) {
-      bricks[i]->last_points[j][0] += 48+100*i;
-      bricks[i]->points[j][0] += 48+100*i;
-      bricks[i]->last_points[j][1] += 500;
-      bricks[i]->points[j][1] += 500;
+  // jellypaddle --compile <scene> <compiled scene>
+  if (argc == 4 && strcmp(argv[1], "--compile") == 0) {
+    scene = scene_read(argv[2]);
+    if (scene == NULL || scene_compile(scene, argv[3]) == false)
+      return 1;
+    scene_free(scene);
+    return 0;
+  }
+
+  // jellypaddle --fleet <worlds> <ticks> [--deterministic] [scene]
+  if (argc >= 4 && strcmp(argv[1], "--fleet") == 0) {
+    num_worlds = atoi(argv[2]);
+    ticks = atoi(argv[3]);
+    for (i = 4; i < argc; i++) {
+      if (strcmp(argv[i], "--deterministic") == 0)
+        deterministic = true;
+      else
+        path = argv[i];
+    }
+    if (num_worlds <= 0 || ticks <= 0) {
+      printf("--fleet needs a number of worlds and ticks\n");
+      return 1;
+    }
+    return run_fleet(path, num_worlds, ticks, deterministic);
+  }
+
+  // jellypaddle --batch <worlds> <ticks> [--threads <n>] [--deterministic]
+  //   [scene]
+  if (argc >= 4 && strcmp(argv[1], "--batch") == 0) {
+    num_worlds = atoi(argv[2]);
+    ticks = atoi(argv[3]);
+    for (i = 4; i < argc; i++) {
+      if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        threads = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--deterministic") == 0)
+        deterministic = true;
+      else
+        path = argv[i];
+    }
+    if (num_worlds <= 0 || ticks <= 0) {
+      printf("--batch needs a number of worlds and ticks\n");
+      return 1;
     }
-    game_add_body(bricks[i]);
+    return run_batch(path, num_worlds, ticks, threads, deterministic);
+  }
+
+  // jellypaddle --net <player> <port> <peer port> [--host <address>]
+  //   [--delay <ticks>] [--ticks <n>] [scene]
+  if (argc >= 5 && strcmp(argv[1], "--net") == 0) {
+    path = "brkout2.scene";
+    for (i = 5; i < argc; i++) {
+      if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+        host = argv[++i];
+      else if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc)
+        delay = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+        ticks = atoi(argv[++i]);
+      else
+        path = argv[i];
+    }
+    if ((atoi(argv[2]) != 0 && atoi(argv[2]) != 1)
+      || atoi(argv[3]) <= 0 || atoi(argv[4]) <= 0)
+    {
+      printf("--net needs a player, 0 or 1, and two ports\n");
+      return 1;
+    }
+    if (ticks == 0)
+      game_init(&argc, argv, "jelly paddle");
+    return run_net(path, atoi(argv[2]), atoi(argv[3]), host, atoi(argv[4]),
+      delay, ticks);
+  }
+
+  // jellypaddle --record <path> <frames> [scene]
+  if (argc >= 4 && strcmp(argv[1], "--record") == 0) {
+    ticks = atoi(argv[3]);
+    if (argc >= 5)
+      path = argv[4];
+    if (ticks <= 0) {
+      printf("--record needs a path and a number of frames\n");
+      return 1;
+    }
+    if (game_init_offscreen(800, 600) == false)
+      return 1;
+    game = breakout_new(game_world(), path, true, 1);
+    if (game == NULL) {
+      game_free();
+      return 1;
+    }
+    game->particles = game_particles();
+    ok = game_record(argv[2], ticks);
+    game_free();
+    breakout_free(game);
+    return ok? 0 : 1;
+  }
+
+  game_init(&argc, argv, "jelly paddle");
+
+  // jellypaddle [--unlimited] [--metrics <file>] [scene]
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--unlimited") == 0)
+      game_set_frame_rate(0.0);
+    else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+      metrics_dump(argv[++i]);
+    else
+      path = argv[i];
+  }
+
+  game = breakout_new(game_world(), path, false, time(NULL));
+  if (game == NULL) {
+    game_free();
+    return 1;
   }
+  game->particles = game_particles();
 
   game_run();
+  game_free();
+  breakout_free(game);
 
   return 0;
 }
@@ -0,0 +1,132 @@
+/**
+ * A bounding volume hierarchy over bodies that don't move: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bvh.h"
+
+static int compare_centers(const void* va, const void* vb, int axis) {
+  Body* a = *(Body**) va;
+  Body* b = *(Body**) vb;
+  float ca = a->bbox[axis] + a->bbox[axis + 2];
+  float cb = b->bbox[axis] + b->bbox[axis + 2];
+  return (ca < cb)? -1 : (ca > cb)? 1 : a->id - b->id;
+}
+
+// one comparator per axis, so worlds can build on separate threads
+static int compare_x(const void* va, const void* vb) {
+  return compare_centers(va, vb, 0);
+}
+
+static int compare_y(const void* va, const void* vb) {
+  return compare_centers(va, vb, 1);
+}
+
+static int build(Bvh* bvh, Body** bodies, int num_bodies) {
+  int index = bvh->num_nodes++;
+  BvhNode* node = &bvh->nodes[index];
+  int i, half;
+
+  memcpy(node->bbox, bodies[0]->bbox, sizeof(vec4));
+  for (i = 1; i < num_bodies; i++) {
+    node->bbox[0] = min(node->bbox[0], bodies[i]->bbox[0]);
+    node->bbox[1] = min(node->bbox[1], bodies[i]->bbox[1]);
+    node->bbox[2] = max(node->bbox[2], bodies[i]->bbox[2]);
+    node->bbox[3] = max(node->bbox[3], bodies[i]->bbox[3]);
+  }
+
+  if (num_bodies == 1) {
+    node->left = node->right = -1;
+    node->body = bodies[0];
+    return index;
+  }
+
+  // split at the median of the longest axis
+  qsort(bodies, num_bodies, sizeof(Body*),
+    (node->bbox[2] - node->bbox[0] >= node->bbox[3] - node->bbox[1])?
+    compare_x : compare_y);
+  half = num_bodies / 2;
+
+  node->body = NULL;
+  node->left = build(bvh, bodies, half);
+  node->right = build(bvh, bodies + half, num_bodies - half);
+  return index;
+}
+
+Bvh* bvh_new() {
+  Bvh* bvh = malloc(sizeof(Bvh));
+  bvh->nodes = NULL;
+  bvh->num_nodes = 0;
+  bvh->capacity = 0;
+  bvh->root = -1;
+  return bvh;
+}
+
+void bvh_free(Bvh* bvh) {
+  free(bvh->nodes);
+  free(bvh);
+}
+
+void bvh_build(Bvh* bvh, Body** bodies, int num_bodies) {
+  // a binary tree over n leaves has 2n - 1 nodes
+  if (bvh->capacity < num_bodies * 2) {
+    bvh->capacity = num_bodies * 2;
+    bvh->nodes = realloc(bvh->nodes, sizeof(BvhNode) * bvh->capacity);
+  }
+
+  bvh->num_nodes = 0;
+  bvh->root = (num_bodies > 0)? build(bvh, bodies, num_bodies) : -1;
+}
+
+void bvh_query(Bvh* bvh, vec4 bbox, bool (*fn)(Body*, void*), void* data) {
+  int stack[64];
+  int top = 0;
+
+  if (bvh->root < 0)
+    return;
+
+  stack[top++] = bvh->root;
+  while (top > 0) {
+    BvhNode* node = &bvh->nodes[stack[--top]];
+    if (bbox_overlap(node->bbox, bbox) == false)
+      continue;
+    if (node->body != NULL) {
+      if (fn(node->body, data))
+        return;
+    } else {
+      stack[top++] = node->left;
+      stack[top++] = node->right;
+    }
+  }
+}
+
+void bvh_raycast(Bvh* bvh, vec2 from, vec2 to,
+  float (*fn)(Body*, float, void*), void* data)
+{
+  int stack[64];
+  int top = 0;
+  float max_fraction = 1.0;
+  vec2 dir = {to[0] - from[0], to[1] - from[1]};
+
+  if (bvh->root < 0)
+    return;
+
+  stack[top++] = bvh->root;
+  while (top > 0) {
+    BvhNode* node = &bvh->nodes[stack[--top]];
+    if (bbox_crossed(node->bbox, from, dir, max_fraction) == false)
+      continue;
+    if (node->body != NULL) {
+      float fraction = fn(node->body, max_fraction, data);
+      if (fraction <= 0.0)
+        return;
+      max_fraction = min(max_fraction, fraction);
+    } else {
+      stack[top++] = node->left;
+      stack[top++] = node->right;
+    }
+  }
+}
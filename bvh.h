@@ -0,0 +1,75 @@
+/**
+ * A bounding volume hierarchy over bodies that don't move
+ * @author Scott LaVigne
+ */
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdbool.h>
+
+#include "body.h"
+
+typedef struct BvhNode {
+
+  vec4 bbox;  // = {minX minY maxX maxY}
+  int left;   // child indices, -1 for leaves
+  int right;
+  Body* body; // NULL for inner nodes
+
+} BvhNode;
+
+typedef struct Bvh {
+
+  BvhNode* nodes;
+  int num_nodes;
+  int capacity;
+  int root;   // -1 when empty
+
+} Bvh;
+
+/**
+ * Create an empty hierarchy.
+ * @return a new hierarchy
+ */
+Bvh* bvh_new();
+
+/**
+ * Free a hierarchy.
+ * @param bvh a hierarchy
+ */
+void bvh_free(Bvh* bvh);
+
+/**
+ * Rebuild the hierarchy from scratch, splitting each node at the
+ * median of its longest axis. Uses the bodies' current bboxes.
+ * @param bvh        a hierarchy
+ * @param bodies     bodies to put in it, the array is reordered
+ * @param num_bodies number of bodies
+ */
+void bvh_build(Bvh* bvh, Body** bodies, int num_bodies);
+
+/**
+ * Visit every body whose bbox overlaps a region.
+ * @param bvh  a hierarchy
+ * @param bbox the region = {minX minY maxX maxY}
+ * @param fn   a function to apply. Its first argument is the body,
+ *             the second is extra data. If it ever returns true the
+ *             query ends.
+ * @param data extra data to pass to the function
+ */
+void bvh_query(Bvh* bvh, vec4 bbox, bool (*fn)(Body*, void*), void* data);
+
+/**
+ * Visit every body whose bbox a segment crosses.
+ * @param bvh  a hierarchy
+ * @param from start of the segment
+ * @param to   end of the segment
+ * @param fn   a function to apply, as for tree_raycast. It returns the
+ *             new reach along the segment: 0 ends the search, a smaller
+ *             fraction clips the segment.
+ * @param data extra data to pass to the function
+ */
+void bvh_raycast(Bvh* bvh, vec2 from, vec2 to,
+  float (*fn)(Body*, float, void*), void* data);
+
+#endif /* BVH_H */
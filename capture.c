@@ -0,0 +1,247 @@
+/**
+ * Writing rendered frames to files: implementation
+ * @author Scott LaVigne
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <GL/glew.h>
+
+#include "capture.h"
+#include "mem.h"
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// flip a frame the right way up and drop alpha, then write it out
+static bool write_frame(Capture* capture, unsigned char* pixels,
+  unsigned index)
+{
+  int width = capture->width, height = capture->height, x, y;
+  size_t size = (size_t) width * height * 3;
+  char name[4096];
+  FILE* file;
+  bool ok;
+
+  for (y = 0; y < height; y++) {
+    unsigned char* from = &pixels[(size_t) (height - 1 - y) * width * 4];
+    unsigned char* to = &capture->row[(size_t) y * width * 3];
+    for (x = 0; x < width; x++) {
+      to[x * 3 + 0] = from[x * 4 + 0];
+      to[x * 3 + 1] = from[x * 4 + 1];
+      to[x * 3 + 2] = from[x * 4 + 2];
+    }
+  }
+
+  if (capture->video != NULL)
+    return fwrite(capture->row, size, 1, capture->video) == 1;
+
+  snprintf(name, sizeof(name), capture->path, index);
+  file = fopen(name, "wb");
+  if (file == NULL) {
+    printf("Could not create frame %s\n", name);
+    return false;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  ok = fwrite(capture->row, size, 1, file) == 1;
+  if (fclose(file) != 0)
+    ok = false;
+  if (ok == false)
+    printf("Could not write frame %s\n", name);
+  return ok;
+}
+
+// count the integer conversions in a frame path, or -1 if it holds
+// any other, as it is the format frame names are printed with
+static int count_conversions(const char* path) {
+  int count = 0;
+  while ((path = strchr(path, '%')) != NULL) {
+    path++;
+    if (*path == '%') {
+      path++;
+      continue;
+    }
+    path += strspn(path, "-+ #0");
+    path += strspn(path, "0123456789");
+    if (*path == '\0' || strchr("diouxX", *path) == NULL)
+      return -1;
+    path++;
+    count++;
+  }
+  return count;
+}
+
+// take frames off the queue in order until capturing is done
+static void* writer(void* data) {
+  Capture* capture = data;
+  unsigned char* pixels;
+  double start;
+
+  for (;;) {
+    pthread_mutex_lock(&capture->lock);
+    while (capture->written == capture->queued && capture->done == false)
+      pthread_cond_wait(&capture->changed, &capture->lock);
+    if (capture->written == capture->queued) {
+      pthread_mutex_unlock(&capture->lock);
+      return NULL;
+    }
+    pixels = capture->queue[capture->written % CAPTURE_QUEUE];
+    pthread_mutex_unlock(&capture->lock);
+
+    // the slot stays out of the capturing thread's reach until written
+    // moves past it
+    start = now();
+    if (capture->failed == false) {
+      if (write_frame(capture, pixels, capture->written))
+        capture->stats.frames++;
+      else
+        capture->failed = true;
+    }
+    capture->stats.write_time += now() - start;
+
+    pthread_mutex_lock(&capture->lock);
+    capture->written++;
+    pthread_cond_broadcast(&capture->changed);
+    pthread_mutex_unlock(&capture->lock);
+  }
+}
+
+Capture* capture_new(const char* path, int width, int height) {
+  size_t size = (size_t) width * height * 4;
+  Capture* capture;
+  int i;
+
+  if (strchr(path, '%') != NULL && count_conversions(path) != 1) {
+    printf("Frame path %s needs one integer conversion, like %%05d\n", path);
+    return NULL;
+  }
+
+  capture = calloc(1, sizeof(Capture));
+  capture->width = width;
+  capture->height = height;
+  capture->path = strdup(path);
+  if (strchr(path, '%') == NULL) {
+    capture->video = fopen(path, "wb");
+    if (capture->video == NULL) {
+      printf("Could not create video %s\n", path);
+      free(capture->path);
+      free(capture);
+      return NULL;
+    }
+  }
+
+  for (i = 0; i < CAPTURE_QUEUE; i++)
+    capture->queue[i] = malloc(size);
+  capture->row = malloc((size_t) width * height * 3);
+  pthread_mutex_init(&capture->lock, NULL);
+  pthread_cond_init(&capture->changed, NULL);
+  if (pthread_create(&capture->writer, NULL, writer, capture) != 0) {
+    printf("Could not start the capture writer\n");
+    capture->done = true;
+    capture_finish(capture, NULL);
+    return NULL;
+  }
+
+  glGenBuffers(CAPTURE_PBOS, capture->pbos);
+  for (i = 0; i < CAPTURE_PBOS; i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    mem_track(MEM_GPU, size);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return capture;
+}
+
+// copy a pixel buffer's frame into the queue, waiting for room
+static void collect(Capture* capture, int pbo) {
+  size_t size = (size_t) capture->width * capture->height * 4;
+  unsigned char* buffer;
+  void* pixels;
+  double start = now();
+
+  pthread_mutex_lock(&capture->lock);
+  if (capture->queued - capture->written == CAPTURE_QUEUE) {
+    capture->stats.stalls++;
+    while (capture->queued - capture->written == CAPTURE_QUEUE)
+      pthread_cond_wait(&capture->changed, &capture->lock);
+    capture->stats.stall_time += now() - start;
+  }
+  buffer = capture->queue[capture->queued % CAPTURE_QUEUE];
+  pthread_mutex_unlock(&capture->lock);
+
+  // the read was started frames ago, so mapping doesn't wait for it
+  start = now();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[pbo]);
+  pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (pixels != NULL) {
+    memcpy(buffer, pixels, size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  } else {
+    memset(buffer, 0, size);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  capture->stats.collect_time += now() - start;
+
+  pthread_mutex_lock(&capture->lock);
+  capture->queued++;
+  pthread_cond_broadcast(&capture->changed);
+  pthread_mutex_unlock(&capture->lock);
+}
+
+void capture_frame(Capture* capture) {
+  // the read goes into a pixel buffer and returns without waiting
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,
+    capture->pbos[capture->frames_read % CAPTURE_PBOS]);
+  glReadPixels(0, 0, capture->width, capture->height, GL_RGBA,
+    GL_UNSIGNED_BYTE, NULL);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  capture->frames_read++;
+
+  // the oldest read in flight is the one the next frame reads into
+  if (capture->frames_read >= CAPTURE_PBOS)
+    collect(capture, capture->frames_read % CAPTURE_PBOS);
+}
+
+bool capture_finish(Capture* capture, CaptureStats* stats) {
+  unsigned frame = 0;
+  bool ok;
+  int i;
+
+  if (capture->done == false) {
+    if (capture->frames_read >= CAPTURE_PBOS)
+      frame = capture->frames_read - CAPTURE_PBOS + 1;
+    for (; frame < capture->frames_read; frame++)
+      collect(capture, frame % CAPTURE_PBOS);
+    glDeleteBuffers(CAPTURE_PBOS, capture->pbos);
+    for (i = 0; i < CAPTURE_PBOS; i++)
+      mem_track(MEM_GPU, -(long) capture->width * capture->height * 4);
+
+    pthread_mutex_lock(&capture->lock);
+    capture->done = true;
+    pthread_cond_broadcast(&capture->changed);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->writer, NULL);
+  }
+
+  ok = capture->failed == false
+    && capture->stats.frames == capture->frames_read;
+  if (capture->video != NULL && fclose(capture->video) != 0) {
+    printf("Could not write video %s\n", capture->path);
+    ok = false;
+  }
+  if (stats != NULL)
+    *stats = capture->stats;
+
+  pthread_mutex_destroy(&capture->lock);
+  pthread_cond_destroy(&capture->changed);
+  for (i = 0; i < CAPTURE_QUEUE; i++)
+    free(capture->queue[i]);
+  free(capture->row);
+  free(capture->path);
+  free(capture);
+  return ok;
+}
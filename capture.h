@@ -0,0 +1,99 @@
+/**
+ * Writing rendered frames to files. Pixels come back from the GPU
+ * through pixel buffer objects a frame behind, so reading never waits
+ * on the frame just drawn, and a thread of its own converts and
+ * writes them while the next frames render.
+ * @author Scott LaVigne
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * Pixel buffer objects read into in turn. Each frame's pixels are
+ * collected this many frames minus one after it is drawn.
+ */
+#define CAPTURE_PBOS 2
+
+/**
+ * Frames waiting for the writer thread. Capturing waits when it is
+ * this far ahead of the writer.
+ */
+#define CAPTURE_QUEUE 8
+
+/**
+ * Counts of the work done
+ */
+typedef struct CaptureStats {
+
+  unsigned frames;     // frames written
+  unsigned stalls;     // frames that waited for the writer
+  double stall_time;   // seconds spent waiting for the writer
+  double collect_time; // seconds spent mapping and copying pixels
+  double write_time;   // seconds the writer spent converting and writing
+
+} CaptureStats;
+
+typedef struct Capture {
+
+  int width, height;
+  char* path;  // a printf pattern for an image sequence, or a file
+  FILE* video; // the raw video being written, NULL for images
+
+  // readback, on the GL thread
+  unsigned pbos[CAPTURE_PBOS];
+  unsigned frames_read; // frames whose readback was started
+
+  // frames handed to the writer, RGBA bottom row first
+  unsigned char* queue[CAPTURE_QUEUE];
+  unsigned queued;  // frames put in the queue
+  unsigned written; // frames the writer took out
+  bool done;        // no more frames are coming
+  bool failed;      // a write failed, the rest are dropped
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t writer;
+  unsigned char* row; // the writer's converted frame
+
+  CaptureStats stats;
+
+} Capture;
+
+/**
+ * Start capturing frames of a size. A path holding a printf
+ * conversion, e.g. "frame%05d.ppm", gets one binary PPM per frame,
+ * numbered from 0. It must be one integer conversion, with flags and
+ * a width at most; "%%" is a literal percent sign. Any other path
+ * without a '%' gets raw video: 8-bit RGB frames
+ * one after another, top row first, as ffmpeg reads with
+ * "-f rawvideo -pix_fmt rgb24 -s <width>x<height>".
+ * Needs a current GL context, the one frames are drawn in.
+ * @param  path   where frames go
+ * @param  width  frame width in pixels
+ * @param  height frame height in pixels
+ * @return        a new capture, or NULL if the file or thread
+ *                couldn't be set up
+ */
+Capture* capture_new(const char* path, int width, int height);
+
+/**
+ * Capture the frame just drawn to the default framebuffer. Call it
+ * after drawing and before swapping buffers. Its pixels are collected
+ * on a later call, or by capture_finish.
+ * @param capture a capture
+ */
+void capture_frame(Capture* capture);
+
+/**
+ * Collect every frame still being read, wait for the writer to write
+ * them, then free the capture.
+ * @param  capture a capture
+ * @param  stats   set to the work done, or NULL
+ * @return         true if every frame was written
+ */
+bool capture_finish(Capture* capture, CaptureStats* stats);
+
+#endif /* CAPTURE_H */
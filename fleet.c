@@ -0,0 +1,542 @@
+/**
+ * Many copies of one world, stepped together: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fleet.h"
+
+// element i of copy w in a per copy array
+#define AT(fleet, i, w) ((i) * (fleet)->num_worlds + (w))
+
+// number of float lanes collide needs
+#define FLEET_LANES 9
+
+static bool collect_body(void* body, void* vcursor) {
+  Body*** cursor = vcursor;
+  *(*cursor)++ = body;
+  return false;
+}
+
+// add a row of points to the sums and bounds of a body. Rows are
+// passed as restricted arguments so the loop vectorises.
+static void bound_row(float* restrict sum, float* restrict lo,
+  float* restrict hi, const float* restrict row, int n)
+{
+  int w;
+  for (w = 0; w < n; w++) {
+    float value = row[w];
+    sum[w] += value;
+    lo[w] = (value < lo[w])? value : lo[w];
+    hi[w] = (value > hi[w])? value : hi[w];
+  }
+}
+
+// centers of mass and bboxes of every body in every copy
+static void centers(Fleet* fleet) {
+  int n = fleet->num_worlds, count = fleet->num_bodies * n;
+  int b, i, w;
+  for (b = 0; b < fleet->num_bodies; b++) {
+    int first = fleet->first_point[b];
+    int num_points = fleet->body_points[b];
+    float* com_x = &fleet->com_x[b * n];
+    float* com_y = &fleet->com_y[b * n];
+    float* min_x = &fleet->bbox[b * n];
+    float* min_y = &fleet->bbox[count + b * n];
+    float* max_x = &fleet->bbox[count * 2 + b * n];
+    float* max_y = &fleet->bbox[count * 3 + b * n];
+
+    memcpy(com_x, &fleet->x[first * n], sizeof(float) * n);
+    memcpy(com_y, &fleet->y[first * n], sizeof(float) * n);
+    memcpy(min_x, com_x, sizeof(float) * n);
+    memcpy(min_y, com_y, sizeof(float) * n);
+    memcpy(max_x, com_x, sizeof(float) * n);
+    memcpy(max_y, com_y, sizeof(float) * n);
+    for (i = first + 1; i < first + num_points; i++) {
+      bound_row(com_x, min_x, max_x, &fleet->x[i * n], n);
+      bound_row(com_y, min_y, max_y, &fleet->y[i * n], n);
+    }
+    for (w = 0; w < n; w++) {
+      com_x[w] /= num_points;
+      com_y[w] /= num_points;
+    }
+  }
+}
+
+Fleet* fleet_new(World* world, int num_worlds) {
+  Fleet* fleet = calloc(1, sizeof(Fleet));
+  Body** bodies = malloc(sizeof(Body*) * world->bodies->length);
+  Body** cursor = bodies;
+  int n = num_worlds;
+  int b, i, j, w, point = 0, edge = 0;
+
+  list_traverse(world->bodies, collect_body, &cursor);
+  fleet->num_worlds = n;
+  fleet->num_bodies = world->bodies->length;
+  for (b = 0; b < fleet->num_bodies; b++) {
+    body_sync_points(bodies[b]);
+    fleet->num_points += bodies[b]->num_points;
+    fleet->num_edges += bodies[b]->num_edges;
+  }
+
+  fleet->first_point = malloc(sizeof(int) * fleet->num_bodies);
+  fleet->body_points = malloc(sizeof(int) * fleet->num_bodies);
+  fleet->first_edge = malloc(sizeof(int) * fleet->num_bodies);
+  fleet->body_edges = malloc(sizeof(int) * fleet->num_bodies);
+  fleet->edges = malloc(sizeof(vec2i) * fleet->num_edges);
+  fleet->lengths = malloc(sizeof(float) * fleet->num_edges);
+  fleet->mass = malloc(sizeof(float) * fleet->num_bodies);
+  fleet->gravity = malloc(sizeof(bool) * fleet->num_bodies);
+  fleet->boxed = malloc(sizeof(bool) * fleet->num_bodies);
+  fleet->start_type = malloc(sizeof(BodyType) * fleet->num_bodies);
+  fleet->start_points = malloc(sizeof(vec2) * fleet->num_points);
+  fleet->pairs = malloc(sizeof(FleetPair)
+    * (fleet->num_bodies * (fleet->num_bodies - 1) / 2 + 1));
+
+  memcpy(fleet->bounds, world->bounds, sizeof(vec4));
+  fleet->gravity_fall = world->gravity;
+  fleet->iterations = world->iterations;
+  fleet->deterministic = world->deterministic;
+
+  fleet->x = malloc(sizeof(float) * fleet->num_points * n);
+  fleet->y = malloc(sizeof(float) * fleet->num_points * n);
+  fleet->last_x = malloc(sizeof(float) * fleet->num_points * n);
+  fleet->last_y = malloc(sizeof(float) * fleet->num_points * n);
+  fleet->type = malloc(fleet->num_bodies * n);
+  fleet->com_x = malloc(sizeof(float) * fleet->num_bodies * n);
+  fleet->com_y = malloc(sizeof(float) * fleet->num_bodies * n);
+  fleet->bbox = malloc(sizeof(float) * 4 * fleet->num_bodies * n);
+  fleet->push_x = calloc(fleet->num_points * n, sizeof(fixed));
+  fleet->push_y = calloc(fleet->num_points * n, sizeof(fixed));
+  fleet->active = malloc(n);
+  fleet->lanes = malloc(sizeof(float) * FLEET_LANES * n);
+  fleet->indices = malloc(sizeof(int) * n);
+  fleet->vertices = malloc(sizeof(int) * n);
+
+  for (b = 0; b < fleet->num_bodies; b++) {
+    Body* body = bodies[b];
+    fleet->first_point[b] = point;
+    fleet->body_points[b] = body->num_points;
+    fleet->first_edge[b] = edge;
+    fleet->body_edges[b] = body->num_edges;
+    fleet->mass[b] = body->mass;
+    fleet->gravity[b] = body->gravity;
+    fleet->boxed[b] = body->boxed;
+    fleet->start_type[b] = body->type;
+    memset(&fleet->type[b * n], body->type, n);
+
+    for (i = 0; i < body->num_edges; i++, edge++) {
+      fleet->edges[edge][0] = point + (body->edges[i].point1 - body->points);
+      fleet->edges[edge][1] = point + (body->edges[i].point2 - body->points);
+      fleet->lengths[edge] = body->edges[i].length;
+    }
+
+    for (i = 0; i < body->num_points; i++, point++) {
+      fleet->start_points[point][0] = body->points[i][0];
+      fleet->start_points[point][1] = body->points[i][1];
+      for (w = 0; w < n; w++) {
+        fleet->x[AT(fleet, point, w)] = body->points[i][0];
+        fleet->y[AT(fleet, point, w)] = body->points[i][1];
+        fleet->last_x[AT(fleet, point, w)] = body->last_points[i][0];
+        fleet->last_y[AT(fleet, point, w)] = body->last_points[i][1];
+      }
+    }
+
+    for (j = b + 1; j < fleet->num_bodies; j++) {
+      if (body->mask & bodies[j]->mask) {
+        fleet->pairs[fleet->num_pairs].body1 = b;
+        fleet->pairs[fleet->num_pairs].body2 = j;
+        fleet->num_pairs++;
+      }
+    }
+  }
+  fleet->touched = calloc(fleet->num_pairs * n + 1, 1);
+
+  free(bodies);
+  centers(fleet);
+  return fleet;
+}
+
+void fleet_free(Fleet* fleet) {
+  free(fleet->first_point);
+  free(fleet->body_points);
+  free(fleet->first_edge);
+  free(fleet->body_edges);
+  free(fleet->edges);
+  free(fleet->lengths);
+  free(fleet->mass);
+  free(fleet->gravity);
+  free(fleet->boxed);
+  free(fleet->start_type);
+  free(fleet->start_points);
+  free(fleet->pairs);
+  free(fleet->x);
+  free(fleet->y);
+  free(fleet->last_x);
+  free(fleet->last_y);
+  free(fleet->type);
+  free(fleet->com_x);
+  free(fleet->com_y);
+  free(fleet->bbox);
+  free(fleet->touched);
+  free(fleet->push_x);
+  free(fleet->push_y);
+  free(fleet->active);
+  free(fleet->lanes);
+  free(fleet->indices);
+  free(fleet->vertices);
+  free(fleet);
+}
+
+// one axis of a row of points, as body_do_verlet
+static void verlet_row(float* restrict row, float* restrict last_row,
+  const unsigned char* restrict type, float fall, float lo, float hi,
+  bool boxed, int n)
+{
+  int w;
+  for (w = 0; w < n; w++) {
+    bool moving = type[w] != BODY_STATIC;
+    float next = row[w] + row[w] - last_row[w]
+      - ((type[w] == BODY_DYNAMIC)? fall : 0.0f);
+    if (boxed)
+      next = (next < lo)? lo : (next > hi)? hi : next;
+    last_row[w] = moving? row[w] : last_row[w];
+    row[w] = moving? next : row[w];
+  }
+}
+
+// static bodies stay put
+static void verlet(Fleet* fleet) {
+  int n = fleet->num_worlds;
+  float* bounds = fleet->bounds;
+  int b, i;
+  for (b = 0; b < fleet->num_bodies; b++) {
+    const unsigned char* type = &fleet->type[b * n];
+    float fall = fleet->gravity[b]? fleet->gravity_fall : 0.0;
+    bool boxed = fleet->boxed[b];
+
+    for (i = fleet->first_point[b];
+      i < fleet->first_point[b] + fleet->body_points[b]; i++)
+    {
+      verlet_row(&fleet->x[i * n], &fleet->last_x[i * n], type,
+        0.0, bounds[0], bounds[2], boxed, n);
+      verlet_row(&fleet->y[i * n], &fleet->last_y[i * n], type,
+        fall, bounds[1], bounds[3], boxed, n);
+    }
+  }
+}
+
+// one edge in every copy, as body_do_edges. Its two points are
+// different rows.
+static void edge_row(float* restrict x1, float* restrict y1,
+  float* restrict x2, float* restrict y2,
+  const unsigned char* restrict type, float length, int n)
+{
+  int w;
+  for (w = 0; w < n; w++) {
+    float dx = x1[w] - x2[w];
+    float dy = y1[w] - y2[w];
+    float d = sqrtf(dx*dx + dy*dy);
+    // a zero length edge has nothing to push along, and dividing by
+    // at least 1e-6 keeps the loop free of branches
+    float diff = ((type[w] != BODY_STATIC)? 0.5f : 0.0f)
+      * (length - d) / ((d > 1e-6f)? d : 1e-6f);
+    x1[w] += dx * diff;
+    y1[w] += dy * diff;
+    x2[w] -= dx * diff;
+    y2[w] -= dy * diff;
+  }
+}
+
+// as edge_row, as a deterministic body_do_edges does it
+static void edge_row_deterministic(float* restrict x1, float* restrict y1,
+  float* restrict x2, float* restrict y2,
+  const unsigned char* restrict type, float length, int n)
+{
+  int w;
+  for (w = 0; w < n; w++) {
+    float dx = x1[w] - x2[w];
+    float dy = y1[w] - y2[w];
+    float diff = ((type[w] != BODY_STATIC)? 0.5f : 0.0f)
+      * (length * rsqrt(dx*dx + dy*dy) - 1.0f);
+    x1[w] += dx * diff;
+    y1[w] += dy * diff;
+    x2[w] -= dx * diff;
+    y2[w] -= dy * diff;
+  }
+}
+
+static void edges(Fleet* fleet) {
+  int n = fleet->num_worlds;
+  int b, e;
+  for (b = 0; b < fleet->num_bodies; b++) {
+    for (e = fleet->first_edge[b];
+      e < fleet->first_edge[b] + fleet->body_edges[b]; e++)
+    {
+      (fleet->deterministic? edge_row_deterministic : edge_row)(
+        &fleet->x[fleet->edges[e][0] * n],
+        &fleet->y[fleet->edges[e][0] * n],
+        &fleet->x[fleet->edges[e][1] * n],
+        &fleet->y[fleet->edges[e][1] * n],
+        &fleet->type[b * n], fleet->lengths[e], n);
+    }
+  }
+}
+
+// project a body's points onto an axis in the copies still being tested
+static void project(Fleet* fleet, int body, const int* lanes, int num_lanes,
+  const float* axis_x, const float* axis_y, float* lo, float* hi)
+{
+  int n = fleet->num_worlds;
+  int first = fleet->first_point[body];
+  int i, k;
+  for (k = 0; k < num_lanes; k++)
+    lo[k] = hi[k] = axis_x[k] * fleet->x[AT(fleet, first, lanes[k])]
+      + axis_y[k] * fleet->y[AT(fleet, first, lanes[k])];
+  for (i = first + 1; i < first + fleet->body_points[body]; i++) {
+    const float* x = &fleet->x[i * n];
+    const float* y = &fleet->y[i * n];
+    for (k = 0; k < num_lanes; k++) {
+      float dot = axis_x[k] * x[lanes[k]] + axis_y[k] * y[lanes[k]];
+      lo[k] = (dot < lo[k])? dot : lo[k];
+      hi[k] = (dot > hi[k])? dot : hi[k];
+    }
+  }
+}
+
+// as handle, for one copy
+static void respond(Fleet* fleet, int w, int body1, int body2, int edge,
+  int vertex, float depth, float normal_x, float normal_y)
+{
+  int n = fleet->num_worlds;
+  int points[3] = {
+    AT(fleet, fleet->edges[edge][0], w),
+    AT(fleet, fleet->edges[edge][1], w),
+    AT(fleet, vertex, w)
+  };
+  vec2 point1 = {fleet->x[points[0]], fleet->y[points[0]]};
+  vec2 point2 = {fleet->x[points[1]], fleet->y[points[1]]};
+  vec2 point3 = {fleet->x[points[2]], fleet->y[points[2]]};
+  vec2 normal = {normal_x, normal_y};
+  vec2 push[3];
+  int i;
+
+  body_contact_push(point1, point2, point3, depth, normal,
+    fleet->mass[body2], fleet->type[body2 * n + w],
+    fleet->mass[body1], fleet->type[body1 * n + w], push);
+  for (i = 0; i < 3; i++) {
+    if (fleet->deterministic) {
+      fleet->push_x[points[i]] += fixed_from_float(push[i][0]);
+      fleet->push_y[points[i]] += fixed_from_float(push[i][1]);
+    } else {
+      fleet->x[points[i]] += push[i][0];
+      fleet->y[points[i]] += push[i][1];
+    }
+  }
+}
+
+// as body_apply_pushes, over every point
+static void push_row(float* restrict row, fixed* restrict push, int n) {
+  int w;
+  for (w = 0; w < n; w++) {
+    row[w] += fixed_to_float(push[w]);
+    push[w] = 0;
+  }
+}
+
+// as do_pair, body1 pushing its deepest point into body2, in the
+// copies the pair is handled from body1: where body1 is dynamic, and
+// body2 isn't if body2 was created first. Few copies overlap at once,
+// so the ones that do are packed into lanes and only those are tested.
+static void collide(Fleet* fleet, int pair, int body1, int body2) {
+  int n = fleet->num_worlds, count = fleet->num_bodies * n;
+  const unsigned char* type1 = &fleet->type[body1 * n];
+  const unsigned char* type2 = &fleet->type[body2 * n];
+  const float* bbox1 = &fleet->bbox[body1 * n];
+  const float* bbox2 = &fleet->bbox[body2 * n];
+  const float* com1_x = &fleet->com_x[body1 * n];
+  const float* com1_y = &fleet->com_y[body1 * n];
+  const float* com2_x = &fleet->com_x[body2 * n];
+  const float* com2_y = &fleet->com_y[body2 * n];
+  unsigned char* active = fleet->active;
+  unsigned char* touched = &fleet->touched[pair * n];
+  int* lanes = fleet->indices;
+  int* vertex = fleet->vertices;
+  float* axis_x = fleet->lanes;
+  float* axis_y = axis_x + n;
+  float* lo1 = axis_y + n;
+  float* hi1 = lo1 + n;
+  float* lo2 = hi1 + n;
+  float* hi2 = lo2 + n;
+  float* depth = hi2 + n;
+  float* normal_x = depth + n;
+  float* normal_y = normal_x + n;
+  float* best = lo1; // free once the axes are done
+  int edges1 = fleet->body_edges[body1];
+  int edges2 = fleet->body_edges[body2];
+  int e, i, k, w, num_lanes = 0;
+
+  for (w = 0; w < n; w++) {
+    bool handled = type1[w] == BODY_DYNAMIC
+      && (body1 < body2 || type2[w] != BODY_DYNAMIC);
+    active[w] = handled
+      && bbox1[w] <= bbox2[count * 2 + w]
+      && bbox1[count + w] <= bbox2[count * 3 + w]
+      && bbox1[count * 2 + w] >= bbox2[w]
+      && bbox1[count * 3 + w] >= bbox2[count + w];
+  }
+  for (w = 0; w < n; w++) {
+    lanes[num_lanes] = w;
+    num_lanes += active[w];
+  }
+  if (num_lanes == 0 || edges2 == 0)
+    return;
+
+  // separating axes are the edges of both bodies. The contact is the
+  // last axis tested, as bodies_colliding leaves it.
+  for (e = 0; e < edges1 + edges2; e++) {
+    int edge = (e < edges1)?
+      fleet->first_edge[body1] + e : fleet->first_edge[body2] + e - edges1;
+    const float* x1 = &fleet->x[fleet->edges[edge][0] * n];
+    const float* y1 = &fleet->y[fleet->edges[edge][0] * n];
+    const float* x2 = &fleet->x[fleet->edges[edge][1] * n];
+    const float* y2 = &fleet->y[fleet->edges[edge][1] * n];
+    int kept = 0;
+
+    for (k = 0; k < num_lanes; k++) {
+      float ax = y1[lanes[k]] - y2[lanes[k]];
+      float ay = x1[lanes[k]] - x2[lanes[k]];
+      float len = fleet->deterministic? rsqrt(ax*ax + ay*ay)
+        : 1.0f / sqrtf(ax*ax + ay*ay);
+      axis_x[k] = ax * len;
+      axis_y[k] = ay * len;
+    }
+    project(fleet, body1, lanes, num_lanes, axis_x, axis_y, lo1, hi1);
+    project(fleet, body2, lanes, num_lanes, axis_x, axis_y, lo2, hi2);
+
+    // drop the copies this axis separates
+    for (k = 0; k < num_lanes; k++) {
+      float dist = (lo1[k] < lo2[k])? lo2[k] - hi1[k] : lo1[k] - hi2[k];
+      lanes[kept] = lanes[k];
+      depth[kept] = fabsf(dist);
+      normal_x[kept] = axis_x[k];
+      normal_y[kept] = axis_y[k];
+      kept += !(dist > 0.0f);
+    }
+    num_lanes = kept;
+    if (num_lanes == 0)
+      return;
+  }
+
+  // the normal points from body2 to body1, and the deepest point of
+  // body1 along it is pushed out
+  for (k = 0; k < num_lanes; k++) {
+    w = lanes[k];
+    float dot = normal_x[k] * (com1_x[w] - com2_x[w])
+      + normal_y[k] * (com1_y[w] - com2_y[w]);
+    normal_x[k] = (dot < 0.0f)? -normal_x[k] : normal_x[k];
+    normal_y[k] = (dot < 0.0f)? -normal_y[k] : normal_y[k];
+    best[k] = 10000.0;
+    vertex[k] = 0;
+  }
+  for (i = fleet->first_point[body1];
+    i < fleet->first_point[body1] + fleet->body_points[body1]; i++)
+  {
+    const float* x = &fleet->x[i * n];
+    const float* y = &fleet->y[i * n];
+    for (k = 0; k < num_lanes; k++) {
+      w = lanes[k];
+      float dot = normal_x[k] * (x[w] - com2_x[w])
+        + normal_y[k] * (y[w] - com2_y[w]);
+      vertex[k] = (dot < best[k])? i : vertex[k];
+      best[k] = (dot < best[k])? dot : best[k];
+    }
+  }
+
+  for (k = 0; k < num_lanes; k++) {
+    touched[lanes[k]] = 1;
+    respond(fleet, lanes[k], body1, body2,
+      fleet->first_edge[body2] + edges2 - 1, vertex[k],
+      depth[k], normal_x[k], normal_y[k]);
+  }
+}
+
+void fleet_step(Fleet* fleet) {
+  int i, p;
+
+  memset(fleet->touched, 0, fleet->num_pairs * fleet->num_worlds);
+  verlet(fleet);
+  for (i = 0; i < fleet->iterations; i++) {
+    edges(fleet);
+    centers(fleet);
+    for (p = 0; p < fleet->num_pairs; p++) {
+      collide(fleet, p, fleet->pairs[p].body1, fleet->pairs[p].body2);
+      collide(fleet, p, fleet->pairs[p].body2, fleet->pairs[p].body1);
+    }
+    if (fleet->deterministic) {
+      push_row(fleet->x, fleet->push_x, fleet->num_points * fleet->num_worlds);
+      push_row(fleet->y, fleet->push_y, fleet->num_points * fleet->num_worlds);
+    }
+  }
+  fleet->steps += fleet->num_worlds;
+}
+
+void fleet_place(Fleet* fleet, int world, int body) {
+  int first = fleet->first_point[body];
+  float com_x = 0.0, com_y = 0.0;
+  int i;
+
+  for (i = first; i < first + fleet->body_points[body]; i++) {
+    fleet->x[AT(fleet, i, world)] = fleet->start_points[i][0];
+    fleet->y[AT(fleet, i, world)] = fleet->start_points[i][1];
+    fleet->last_x[AT(fleet, i, world)] = fleet->start_points[i][0];
+    fleet->last_y[AT(fleet, i, world)] = fleet->start_points[i][1];
+    com_x += fleet->start_points[i][0];
+    com_y += fleet->start_points[i][1];
+  }
+  fleet->type[AT(fleet, body, world)] = fleet->start_type[body];
+  fleet->com_x[AT(fleet, body, world)] = com_x / fleet->body_points[body];
+  fleet->com_y[AT(fleet, body, world)] = com_y / fleet->body_points[body];
+}
+
+int fleet_pair(Fleet* fleet, int body1, int body2) {
+  int p;
+  if (body1 > body2) {
+    int body = body1;
+    body1 = body2;
+    body2 = body;
+  }
+  for (p = 0; p < fleet->num_pairs; p++)
+    if (fleet->pairs[p].body1 == body1 && fleet->pairs[p].body2 == body2)
+      return p;
+  return -1;
+}
+
+void fleet_observe(Fleet* fleet, const int* bodies, int num_bodies,
+  float* out)
+{
+  int n = fleet->num_worlds;
+  int i, w;
+  for (i = 0; i < num_bodies; i++) {
+    const float* com_x = &fleet->com_x[bodies[i] * n];
+    const float* com_y = &fleet->com_y[bodies[i] * n];
+    for (w = 0; w < n; w++) {
+      out[(w * num_bodies + i) * 2] = com_x[w];
+      out[(w * num_bodies + i) * 2 + 1] = com_y[w];
+    }
+  }
+}
+
+unsigned fleet_checksum(Fleet* fleet, int world) {
+  unsigned hash = WORLD_CHECKSUM_SEED;
+  int i;
+  for (i = 0; i < fleet->num_points; i++) {
+    vec2 point = {
+      fleet->x[AT(fleet, i, world)], fleet->y[AT(fleet, i, world)]
+    };
+    hash = world_hash_point(hash, point);
+  }
+  return hash;
+}
@@ -0,0 +1,143 @@
+/**
+ * Many copies of one world, stepped together. Every copy has the same
+ * bodies and edges, so their state is laid out structure of arrays
+ * with the copies side by side, and each kernel runs one body, edge or
+ * pair across every copy in a single inner loop.
+ * @author Scott LaVigne
+ */
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdbool.h>
+
+#include "world.h"
+
+/**
+ * Two bodies that may collide, in every copy
+ */
+typedef struct FleetPair {
+
+  int body1, body2; // body indices, body1 < body2
+
+} FleetPair;
+
+typedef struct Fleet {
+
+  int num_worlds; // copies, the stride of every per copy array
+  int num_bodies;
+  int num_points; // per copy, over every body
+  int num_edges;
+  int num_pairs;
+
+  // shared by every copy, taken from the template world. Bodies are
+  // indexed by their id in it, points and edges by body in order.
+  int* first_point;     // per body
+  int* body_points;     // per body
+  int* first_edge;      // per body
+  int* body_edges;      // per body
+  vec2i* edges;         // copy point indices
+  float* lengths;       // rest length per edge
+  float* mass;          // per body
+  bool* gravity;        // per body
+  bool* boxed;          // per body
+  BodyType* start_type; // per body, restored by fleet_place
+  vec2* start_points;   // per point, restored by fleet_place
+  FleetPair* pairs;     // every pair whose masks overlap
+
+  // solver settings, from the template world
+  vec4 bounds;
+  float gravity_fall;
+  int iterations;
+  bool deterministic; // as a deterministic world steps
+
+  // state. Element [i * num_worlds + w] is point, body or pair i of
+  // copy w.
+  float* x;
+  float* y;
+  float* last_x;
+  float* last_y;
+  unsigned char* type;    // BodyType per body, a brick may break in one
+                          // copy and not another
+  float* com_x;           // center of mass per body
+  float* com_y;
+  float* bbox;            // per body, four arrays of num_bodies * num_worlds
+                          // = {minX minY maxX maxY}
+  unsigned char* touched; // per pair, set if it collided in the last step
+  fixed* push_x;          // per point, held back contact pushes in a
+  fixed* push_y;          // deterministic collision pass
+
+  // scratch, one lane per copy
+  unsigned char* active;
+  int* indices;  // copies packed into lanes
+  float* lanes;
+  int* vertices;
+
+  unsigned long steps; // copy steps taken, over every copy
+
+} Fleet;
+
+/**
+ * Create copies of a world. Every body is copied as it is now, along
+ * with the world's bounds and solver settings, determinism included.
+ * Rigid bodies, levels of detail, pressure, shape matching, joints and
+ * callbacks are not carried over; step logic instead reads and writes
+ * the arrays between steps.
+ * @param  world      a template world
+ * @param  num_worlds number of copies
+ * @return            a new fleet
+ */
+Fleet* fleet_new(World* world, int num_worlds);
+
+/**
+ * Free a fleet. The template world is untouched.
+ * @param fleet a fleet
+ */
+void fleet_free(Fleet* fleet);
+
+/**
+ * Step every copy once: integration, then the constraint and
+ * collision passes, as world_step does. Pairs that collide are
+ * flagged in touched.
+ * @param fleet a fleet
+ */
+void fleet_step(Fleet* fleet);
+
+/**
+ * Put a body of one copy back in its starting pose at rest, with its
+ * starting type.
+ * @param fleet a fleet
+ * @param world copy index
+ * @param body  body index
+ */
+void fleet_place(Fleet* fleet, int world, int body);
+
+/**
+ * Find the pair two bodies make.
+ * @param  fleet a fleet
+ * @param  body1 body index
+ * @param  body2 body index
+ * @return       pair index, or -1 if the bodies never collide
+ */
+int fleet_pair(Fleet* fleet, int body1, int body2);
+
+/**
+ * Copy the centers of some bodies in every copy to a flat array.
+ * @param fleet      a fleet
+ * @param bodies     body indices
+ * @param num_bodies number of bodies
+ * @param out        filled row per copy, {x y} per body in order, so
+ *                   out[(w * num_bodies + i) * 2] is the x of body i in
+ *                   copy w
+ */
+void fleet_observe(Fleet* fleet, const int* bodies, int num_bodies,
+  float* out);
+
+/**
+ * Hash the points of one copy, as world_checksum hashes a world.
+ * @param  fleet a fleet
+ * @param  world copy index
+ * @return       the checksum
+ */
+unsigned fleet_checksum(Fleet* fleet, int world);
+
+#endif /* FLEET_H */
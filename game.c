@@ -3,23 +3,48 @@
  * @author Scott LaVigne
  */
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "capture.h"
 #include "game.h"
 #include "list.h"
+#include "mem.h"
+#include "metrics.h"
+#include "net.h"
 #include "shader.h"
 
-bool GAME_KEY_PRESSED[256];
-bool GAME_KEY_HELD[256];
-bool GAME_KEY_RELEASED[256];
+static World* world;
+static Particles* particles;
+static Net* net; // steps the world when playing over the network
 
 static bool window_open = true;
-static clock_t start_time;
+static bool offscreen; // drawing into an EGL pbuffer, no window
+static uint64_t start_time;
 static double t0, t1;
 
+// frame pacing
+static double frame_time = 1.0 / 60.0; // 0 for unlimited
+static double next_frame;              // deadline of the current frame
+static double tick_time;               // time not yet simulated
+static float frame_samples[GAME_FRAME_SAMPLES];
+static unsigned num_frames;
+static unsigned missed_frames;
+
+static int window_width = 800;
+static int window_height = 600;
+static vec2 camera_center = {400.0, 300.0};
+static float camera_zoom = 1.0;
+static bool camera_dirty = true;
+static vec4 view; // = {minX minY maxX maxY}
+
 extern Pipeline* body_program;
 extern unsigned body_vao;
-extern List* bodies;
 
 static uint64_t raw_time() {
   struct timespec ts;
@@ -31,40 +56,80 @@ static double get_time() {
   return (double) (raw_time() - start_time) * 1e-9;
 }
 
+// events wait in the world for the next tick
 static void keyboard_down(unsigned char key, int x, int y) {
-  GAME_KEY_PRESSED[key] = true;
-  GAME_KEY_HELD[key] = true;
-  GAME_KEY_RELEASED[key] = false;
+  world_push_event(world, key, true, get_time());
 }
 
 static void keyboard_up(unsigned char key, int x, int y) {
-  GAME_KEY_PRESSED[key] = false;
-  GAME_KEY_HELD[key] = false;
-  GAME_KEY_RELEASED[key] = true;
+  world_push_event(world, key, false, get_time());
 }
 
 static void keyboard_special_down(int key, int x, int y) {
-  GAME_KEY_PRESSED[key] = true;
-  GAME_KEY_HELD[key] = true;
-  GAME_KEY_RELEASED[key] = false;
+  if (WORLD_SPECIAL(key) < WORLD_NUM_KEYS)
+    world_push_event(world, WORLD_SPECIAL(key), true, get_time());
 }
 
 static void keyboard_special_up(int key, int x, int y) {
-  GAME_KEY_PRESSED[key] = false;
-  GAME_KEY_HELD[key] = false;
-  GAME_KEY_RELEASED[key] = true;
+  if (WORLD_SPECIAL(key) < WORLD_NUM_KEYS)
+    world_push_event(world, WORLD_SPECIAL(key), false, get_time());
 }
 
 static void window_close() {
   window_open = false;
 }
 
-static void reprocess_keys() {
-  int i;
-  for (i = 0; i < 256; i++) {
-    GAME_KEY_PRESSED[i] &= false;
-    GAME_KEY_RELEASED[i] &= false;
-  }
+static void window_reshape(int width, int height) {
+  window_width = max(width, 1);
+  window_height = max(height, 1);
+  glViewport(0, 0, window_width, window_height);
+  camera_dirty = true;
+}
+
+// recompute the view and its projection after the camera moves
+static void update_camera() {
+  float half_width = window_width * 0.5 / camera_zoom;
+  float half_height = window_height * 0.5 / camera_zoom;
+  vec2 scale, offset;
+
+  if (camera_dirty == false)
+    return;
+
+  view[0] = camera_center[0] - half_width;
+  view[1] = camera_center[1] - half_height;
+  view[2] = camera_center[0] + half_width;
+  view[3] = camera_center[1] + half_height;
+
+  scale[0] = 1.0 / half_width;
+  scale[1] = 1.0 / half_height;
+  offset[0] = -camera_center[0] * scale[0];
+  offset[1] = -camera_center[1] * scale[1];
+  pipeline_uniform(body_program, "scale", scale, sizeof(vec2));
+  pipeline_uniform(body_program, "offset", offset, sizeof(vec2));
+  camera_dirty = false;
+}
+
+// everything after the context is current, window or not
+static void init_world() {
+  glewExperimental = true;
+  glewInit();
+  shader_init();
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  world = world_new();
+  world->tick = GAME_TICK;
+  particles = particles_new(world, GAME_PARTICLES);
+  Shader* vert_shader = shader_new(SHADER_VERTEX, "body.vert");
+  Shader* frag_shader = shader_new(SHADER_FRAGMENT, "body.frag");
+  if (vert_shader == NULL || frag_shader == NULL)
+    exit(1);
+  body_program = pipeline_new(vert_shader, frag_shader);
+  pipeline_watch(body_program);
+
+  glGenVertexArrays(1, &body_vao);
+  glBindVertexArray(body_vao);
+
+  update_camera();
 }
 
 void game_init(int* argc, char** argv, const char* title) {
@@ -75,99 +140,335 @@ void game_init(int* argc, char** argv, const char* title) {
   glutInitContextProfile(GLUT_FORWARD_COMPATIBLE);
   glutInitContextProfile(GLUT_CORE_PROFILE);
   glutCreateWindow(title);
-  glewExperimental = true;
-  glewInit();
 
   glutKeyboardFunc(keyboard_down);
   glutKeyboardUpFunc(keyboard_up);
   glutSpecialFunc(keyboard_special_down);
   glutSpecialUpFunc(keyboard_special_up);
   glutCloseFunc(window_close);
-
+  glutReshapeFunc(window_reshape);
   glutSetKeyRepeat(GLUT_KEY_REPEAT_OFF);
-  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-  bodies = list_new();
-  body_program = pipeline_new(
-    shader_new(SHADER_VERTEX, "body.vert"),
-    shader_new(SHADER_FRAGMENT, "body.frag"));
+  init_world();
+}
 
-  glGenVertexArrays(1, &body_vao);
-  glBindVertexArray(body_vao);
+bool game_init_offscreen(int width, int height) {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLConfig config;
+  EGLSurface surface;
+  EGLContext context;
+  EGLint num_configs;
+  EGLint config_attributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+    EGL_NONE
+  };
+  EGLint surface_attributes[] = {
+    EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE
+  };
+  EGLint context_attributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE
+  };
+
+  // Mesa's surfaceless platform needs no display server at all
+  get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+    eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (get_platform_display != NULL)
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+      EGL_DEFAULT_DISPLAY, NULL);
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || eglInitialize(display, NULL, NULL) == false) {
+    printf("Could not open an EGL display\n");
+    return false;
+  }
 
-  pipeline_attribute(body_program, "coord", 0);
-  pipeline_attribute(body_program, "color", 1);
-}
+  if (eglChooseConfig(display, config_attributes, &config, 1, &num_configs)
+    == false || num_configs < 1)
+  {
+    printf("No EGL config can draw offscreen\n");
+    return false;
+  }
+  surface = eglCreatePbufferSurface(display, config, surface_attributes);
+  eglBindAPI(EGL_OPENGL_API);
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+    context_attributes);
+  if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT
+    || eglMakeCurrent(display, surface, surface, context) == false)
+  {
+    printf("Could not create an offscreen OpenGL 3.1 context\n");
+    return false;
+  }
 
-static bool do_verlet(void* body, void* dt) {
-  body_do_verlet(body, *(double*) dt);
-  return false;
+  offscreen = true;
+  window_width = width;
+  window_height = height;
+  glViewport(0, 0, width, height);
+  camera_dirty = true;
+  init_world();
+  return true;
 }
 
-static bool do_step(void* body, void* dt) {
-  body_do_step(body, *(double*) dt);
+// skip bodies outside the view, they cost neither upload nor draw
+static bool do_render(void* vbody, void* data) {
+  Body* body = vbody;
+  if (body->bbox[0] <= view[2] && body->bbox[2] >= view[0]
+    && body->bbox[1] <= view[3] && body->bbox[3] >= view[1])
+    body_do_render(body);
   return false;
 }
 
-static bool do_edges(void* body, void* data) {
-  body_do_edges(body);
+static bool count_body(void* vbody, void* data) {
+  Body* body = vbody;
+  metrics_add(METRIC_POINTS, body->num_points);
+  metrics_add(METRIC_EDGES, body->num_edges);
   return false;
 }
 
-static bool do_center(void* body, void* data) {
-  body_do_center(body);
-  return false;
+// one fixed physics tick, the world's counters feed the metrics
+static void tick() {
+  WorldStats* stats = &world->stats;
+
+  world_process_input(world, get_time());
+  update_camera();
+  memcpy(world->view, view, sizeof(vec4));
+  memset(stats, 0, sizeof(WorldStats));
+  if (net != NULL) {
+    // the session's counters run for the whole game
+    NetStats last = net->stats;
+    net_tick(net);
+    metrics_add(METRIC_ROLLBACK_TICKS,
+      net->stats.rollback_ticks - last.rollback_ticks);
+    if (net->stats.rollbacks > last.rollbacks)
+      metrics_time(METRIC_ROLLBACK_TIME,
+        net->stats.rollback_time - last.rollback_time);
+  } else {
+    world_step(world);
+  }
+  if (particles_count(particles) > 0) {
+    double start = metrics_now();
+    particles_step(particles);
+    metrics_time(METRIC_PARTICLE_TIME, metrics_now() - start);
+  }
+
+  metrics_time(METRIC_COLLIDE_TIME, stats->collide_time);
+  metrics_add(METRIC_TICKS, stats->ticks);
+  metrics_add(METRIC_ITERATIONS, stats->iterations);
+  metrics_add(METRIC_PAIRS, stats->pairs);
+  metrics_add(METRIC_HITS, stats->hits);
+  metrics_add(METRIC_CONTACTS, stats->contacts);
 }
 
-static bool do_collisions(void* body, void* data) {
-  body_do_collisions(body);
-  return false;
+static void render() {
+  double start = metrics_now();
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  shader_poll();
+  update_camera();
+  if (pipeline_use(body_program)) {
+    glEnableVertexAttribArray(pipeline_attribute(body_program, "coord"));
+    glEnableVertexAttribArray(pipeline_attribute(body_program, "color"));
+    list_traverse(world->bodies, do_render, NULL);
+    particles_render(particles);
+  }
+
+  // the overlay leaves the view uniforms set for the window
+  if (metrics_overlay()) {
+    metrics_render(window_width, window_height);
+    camera_dirty = true;
+  }
+
+  if (offscreen == false)
+    glutSwapBuffers();
+  metrics_time(METRIC_RENDER_TIME, metrics_now() - start);
 }
 
-static bool do_render(void* body, void* data) {
-  body_do_render(body);
-  return false;
+static void end_frame() {
+  metrics_set(METRIC_BODIES, world->bodies->length);
+  metrics_set(METRIC_POINTS, 0);
+  metrics_set(METRIC_EDGES, 0);
+  metrics_set(METRIC_PARTICLES, particles_count(particles));
+  metrics_set(METRIC_MEMORY, mem_total() / 1024);
+  list_traverse(world->bodies, count_body, NULL);
+  metrics_frame();
 }
 
-static void step(int value) {
-  static double dt;
-  int i;
+// run the ticks that are due, then draw
+static void frame() {
+  double start;
+  int ticks = 0;
   t1 = get_time();
-  dt = t1 - t0;
+  frame_samples[num_frames++ % GAME_FRAME_SAMPLES] = t1 - t0;
+  metrics_time(METRIC_FRAME_TIME, t1 - t0);
+  tick_time += t1 - t0;
   t0 = t1;
 
-  reprocess_keys();
-  list_traverse(bodies, do_step, &dt);
-  list_traverse(bodies, do_verlet, &dt);
-
-  for (i = 0; i < 5; i++) {
-    list_traverse(bodies, do_edges, NULL);
-    list_traverse(bodies, do_center, NULL);
-    list_traverse(bodies, do_collisions, NULL);
+  start = metrics_now();
+  // ticks may run a little early, so frames paced to the tick rate
+  // don't jitter between none and two
+  while (tick_time >= GAME_TICK - 0.001 && ticks < GAME_MAX_TICKS) {
+    tick();
+    tick_time -= GAME_TICK;
+    ticks++;
   }
+  if (tick_time >= GAME_TICK)
+    tick_time = 0.0;
+  if (ticks > 0)
+    metrics_time(METRIC_PHYSICS_TIME, metrics_now() - start);
 
-  glClear(GL_COLOR_BUFFER_BIT);
+  render();
+  end_frame();
+}
 
-  glUseProgram(body_program->id);
-  glEnableVertexAttribArray(body_program->attribute[0]);
-  glEnableVertexAttribArray(body_program->attribute[1]);
-  list_traverse(bodies, do_render, &dt);
+// wait out the rest of the frame: sleep while the deadline is far,
+// then spin, since a sleep can wake late
+static void pace() {
+  double now = get_time(), wait;
+  struct timespec ts;
+
+  if (frame_time <= 0.0)
+    return;
 
-  glutSwapBuffers();
-  glutTimerFunc(16.6667, step, 0);
+  next_frame += frame_time;
+  if (now > next_frame) {
+    missed_frames++;
+    next_frame = now;
+    return;
+  }
+
+  wait = next_frame - now - GAME_SPIN_TIME;
+  if (wait > 0.0) {
+    ts.tv_sec = (time_t) wait;
+    ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+  }
+  while (get_time() < next_frame);
+}
+
+static int compare_samples(const void* va, const void* vb) {
+  float a = *(const float*) va, b = *(const float*) vb;
+  return (a < b)? -1 : (a > b)? 1 : 0;
 }
 
 void game_run() {
-  glutTimerFunc(16.6667, step, 0);
+  double p50, p99, latency, worst;
+  unsigned missed;
+
+  glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+  start_time = raw_time();
+  t0 = next_frame = get_time();
+
+  while (window_open) {
+    glutMainLoopEvent();
+    if (window_open == false)
+      break;
+    frame();
+    pace();
+  }
+
+  game_get_frame_stats(&p50, &p99, &missed);
+  world_get_input_latency(world, &latency, &worst);
+  printf("%u frames, p50 %.2fms, p99 %.2fms, %u missed deadlines\n",
+    num_frames, p50 * 1e3, p99 * 1e3, missed);
+  printf("input latency: average %.2fms, worst %.2fms\n",
+    latency * 1e3, worst * 1e3);
+}
+
+bool game_record(const char* path, int frames) {
+  CaptureStats stats;
+  Capture* capture;
+  double start, time;
+  bool ok;
+  int i;
+
+  capture = capture_new(path, window_width, window_height);
+  if (capture == NULL)
+    return false;
+
   start_time = raw_time();
-  t0 = get_time();
-  glutMainLoop();
+  start = t0 = get_time();
+  for (i = 0; i < frames; i++) {
+    tick();
+    render();
+    capture_frame(capture);
+    t1 = get_time();
+    frame_samples[num_frames++ % GAME_FRAME_SAMPLES] = t1 - t0;
+    metrics_time(METRIC_FRAME_TIME, t1 - t0);
+    t0 = t1;
+    end_frame();
+  }
+  ok = capture_finish(capture, &stats);
+  time = get_time() - start;
+
+  printf("%u of %d frames written to %s in %.2fs, %.1f frames/s\n",
+    stats.frames, frames, path, time, (time > 0.0)? frames / time : 0.0);
+  printf("readback %.3fms per frame, writing %.3fms per frame on its thread, "
+    "%u stalls waiting for it\n",
+    (frames > 0)? stats.collect_time * 1e3 / frames : 0.0,
+    (stats.frames > 0)? stats.write_time * 1e3 / stats.frames : 0.0,
+    stats.stalls);
+  return ok;
+}
+
+void game_set_frame_rate(double rate) {
+  frame_time = (rate > 0.0)? 1.0 / rate : 0.0;
+}
+
+void game_get_frame_stats(double* p50, double* p99, unsigned* missed) {
+  static float sorted[GAME_FRAME_SAMPLES];
+  unsigned count = (num_frames < GAME_FRAME_SAMPLES)?
+    num_frames : GAME_FRAME_SAMPLES;
+
+  *missed = missed_frames;
+  if (count == 0) {
+    *p50 = *p99 = 0.0;
+    return;
+  }
+  memcpy(sorted, frame_samples, sizeof(float) * count);
+  qsort(sorted, count, sizeof(float), compare_samples);
+  *p50 = sorted[count / 2];
+  *p99 = sorted[(count * 99) / 100];
 }
 
 void game_set_title(const char* title) {
-  glutSetWindowTitle(title);
+  if (offscreen == false)
+    glutSetWindowTitle(title);
+}
+
+void game_set_camera(float x, float y, float zoom) {
+  camera_center[0] = x;
+  camera_center[1] = y;
+  camera_zoom = zoom;
+  camera_dirty = true;
+}
+
+void game_get_view(vec4 out) {
+  update_camera();
+  memcpy(out, view, sizeof(vec4));
+}
+
+World* game_world() {
+  return world;
+}
+
+Particles* game_particles() {
+  return particles;
+}
+
+void game_set_net(Net* session) {
+  net = session;
 }
 
-void game_add_body(Body* body) {
-  list_push_back(bodies, body);
+void game_free() {
+  particles_free(particles);
+  world_free(world);
+  pipeline_free(body_program);
+  glDeleteVertexArrays(1, &body_vao);
+  metrics_free();
+  particles = NULL;
+  world = NULL;
+  body_program = NULL;
+  body_vao = 0;
 }
@@ -11,27 +11,42 @@
 #include <GL/freeglut.h>
 #include <GL/freeglut_ext.h>
 
-#include "body.h"
+#include "world.h"
+#include "net.h"
+#include "particles.h"
 
 /**
- * Array of keystates for testing key being pressed in a frame
+ * Length of a physics tick in seconds. The world always steps at this
+ * rate, however fast frames are drawn.
  */
-extern bool GAME_KEY_PRESSED[];
+#define GAME_TICK (1.0 / 60.0)
 
 /**
- * Array of keystates for testing key being held in a frame.
- * Essentially, this tells you if you are still pressing a key you
- * pressed last frame.
+ * Most physics ticks run before a frame is drawn. A frame further
+ * behind than this drops the time instead, so the game slows down
+ * rather than spiralling.
  */
-extern bool GAME_KEY_HELD[];
+#define GAME_MAX_TICKS 5
 
 /**
- * Array of keystates for testing key being released in a frame.
+ * How long before a frame's deadline the loop stops sleeping and
+ * spins, in seconds. Sleeps overshoot by about this much.
  */
-extern bool GAME_KEY_RELEASED[];
+#define GAME_SPIN_TIME 0.002
 
 /**
- * Initialize a physics world.
+ * Frame times kept for the percentiles reported on exit
+ */
+#define GAME_FRAME_SAMPLES 4096
+
+/**
+ * Most debris particles alive at once
+ */
+#define GAME_PARTICLES 8192
+
+/**
+ * Open the window and create the world it shows. Keyboard events go
+ * to the world's input queue.
  * @param argc  passed from main
  * @param argv  passed from main
  * @param title a window title to use initially
@@ -39,10 +54,50 @@ extern bool GAME_KEY_RELEASED[];
 void game_init(int* argc, char** argv, const char* title);
 
 /**
- * Start the physics step.
+ * Create the world with an offscreen OpenGL context instead of a
+ * window, through EGL. Mesa's surfaceless platform is tried first, so
+ * no display server is needed; LIBGL_ALWAYS_SOFTWARE=1 has Mesa draw
+ * on the CPU where there is no GPU. Frames are drawn into a pbuffer
+ * and there is no keyboard.
+ * @param  width  frame width in pixels
+ * @param  height frame height in pixels
+ * @return        false if no context could be created
+ */
+bool game_init_offscreen(int width, int height);
+
+/**
+ * Run the game one tick per frame as fast as frames can be drawn and
+ * captured, see capture_new for the formats, then print the capture
+ * throughput. Meant for an offscreen game.
+ * @param  path   where frames go
+ * @param  frames frames to capture
+ * @return        true if every frame was written
+ */
+bool game_record(const char* path, int frames);
+
+/**
+ * Run the game until the window closes, then print frame time
+ * percentiles and missed deadlines.
  */
 void game_run();
 
+/**
+ * Set the frame rate the main loop paces itself to. Physics ticks
+ * are unaffected, see GAME_TICK.
+ * @param rate frames per second, or 0 to draw frames as fast as
+ *             possible. Defaults to 60.
+ */
+void game_set_frame_rate(double rate);
+
+/**
+ * Get frame time statistics over the recent frames.
+ * @param p50    set to the median frame time in seconds
+ * @param p99    set to the 99th percentile frame time in seconds
+ * @param missed set to the number of frames that overran their
+ *               deadline since the game started
+ */
+void game_get_frame_stats(double* p50, double* p99, unsigned* missed);
+
 /**
  * Change the window title.
  * @param title a new title to use
@@ -50,9 +105,44 @@ void game_run();
 void game_set_title(const char* title);
 
 /**
- * Add a body to the physics world.
- * @param body a body to add
+ * Point the camera. Only bodies inside the view are uploaded and drawn.
+ * @param x    world x coordinate at the center of the window
+ * @param y    world y coordinate at the center of the window
+ * @param zoom window pixels per world unit
+ */
+void game_set_camera(float x, float y, float zoom);
+
+/**
+ * Get the region of the world currently in view.
+ * @param view filled with {minX minY maxX maxY}
+ */
+void game_get_view(vec4 view);
+
+/**
+ * Get the world the game steps and draws.
+ * @return the world, valid after game_init
+ */
+World* game_world();
+
+/**
+ * Get the game's debris. It steps after the world each tick and draws
+ * over the bodies.
+ * @return the particles, valid after game_init
+ */
+Particles* game_particles();
+
+/**
+ * Step the world through a network session rather than directly. Its
+ * rollbacks feed the rollback metrics.
+ * @param net a session on the game's world, or NULL to step alone
+ */
+void game_set_net(Net* net);
+
+/**
+ * Free the game's world and its bodies, the debris, the body
+ * pipeline and the metrics overlay. A network session on the world,
+ * or a scene spawned into it, goes first or after respectively.
  */
-void game_add_body(Body* body);
+void game_free();
 
 #endif /* GAME_H */
@@ -0,0 +1,200 @@
+/**
+ * Joints: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "joint.h"
+#include "mem.h"
+#include "world.h"
+
+// a joint's point as an index into the world's point pool
+#define POOL_INDEX(body, point) ((body)->first_point + (point))
+
+static Joint* new_joint(World* world, Body* body1, int point1) {
+  Joint* joint;
+  if (body1->world != world || point1 < 0 || point1 >= body1->num_points) {
+    printf("A joint needs a point of a body in its world\n");
+    return NULL;
+  }
+  if (world->num_joints == world->joint_capacity) {
+    world->joint_capacity = (world->joint_capacity > 0)?
+      world->joint_capacity * 2 : 64;
+    world->joints = mem_realloc(MEM_JOINTS, world->joints,
+      sizeof(Joint) * world->joint_capacity);
+  }
+  joint = &world->joints[world->num_joints++];
+  memset(joint, 0, sizeof(Joint));
+  joint->body1 = body1;
+  joint->point1 = point1;
+  world->joints_dirty = true;
+  body1->num_joints++;
+  return joint;
+}
+
+bool joint_add(World* world, JointType type, Body* body1, int point1,
+  Body* body2, int point2, float stiffness, float damping)
+{
+  Joint* joint;
+  float dx, dy;
+
+  if (type == JOINT_PIN || body2 == NULL || body2 == body1
+    || body2->world != world || point2 < 0 || point2 >= body2->num_points)
+  {
+    printf("A joint needs points of two bodies in its world\n");
+    return false;
+  }
+  joint = new_joint(world, body1, point1);
+  if (joint == NULL)
+    return false;
+
+  body_sync_points(body1);
+  body_sync_points(body2);
+  dx = body1->points[point1][0] - body2->points[point2][0];
+  dy = body1->points[point1][1] - body2->points[point2][1];
+  joint->type = type;
+  joint->body2 = body2;
+  joint->point2 = point2;
+  joint->length = sqrt(dx*dx + dy*dy);
+  joint->stiffness = stiffness;
+  joint->damping = (type == JOINT_SPRING)? damping : 0.0;
+  body2->num_joints++;
+  return true;
+}
+
+bool joint_add_pin(World* world, Body* body, int point, vec2 anchor,
+  float stiffness)
+{
+  Joint* joint = new_joint(world, body, point);
+  float dx, dy;
+  if (joint == NULL)
+    return false;
+
+  body_sync_points(body);
+  dx = body->points[point][0] - anchor[0];
+  dy = body->points[point][1] - anchor[1];
+  joint->type = JOINT_PIN;
+  joint->point2 = -1;
+  joint->anchor[0] = anchor[0];
+  joint->anchor[1] = anchor[1];
+  joint->length = sqrt(dx*dx + dy*dy);
+  joint->stiffness = stiffness;
+  return true;
+}
+
+// Greedy coloring: each joint takes the first color neither of its
+// points has yet. Joints are then sorted by color, keeping their order
+// within one, so the same joints added in the same order always solve
+// the same way.
+static void color_joints(World* world) {
+  unsigned* used = mem_calloc(MEM_JOINTS, world->num_points,
+    sizeof(unsigned));
+  Joint* sorted = mem_alloc(MEM_JOINTS, sizeof(Joint) * world->num_joints);
+  int counts[JOINT_COLORS] = {0};
+  int i, color;
+
+  for (i = 0; i < world->num_joints; i++) {
+    Joint* joint = &world->joints[i];
+    int a = POOL_INDEX(joint->body1, joint->point1);
+    unsigned taken = used[a];
+    int b = -1;
+    if (joint->body2 != NULL) {
+      b = POOL_INDEX(joint->body2, joint->point2);
+      taken |= used[b];
+    }
+    for (color = 0; color < JOINT_COLORS - 1; color++) {
+      if ((taken & (1u << color)) == 0)
+        break;
+    }
+    joint->color = color;
+    used[a] |= 1u << color;
+    if (b >= 0)
+      used[b] |= 1u << color;
+    counts[color]++;
+  }
+
+  world->num_colors = 0;
+  world->color_starts[0] = 0;
+  for (color = 0; color < JOINT_COLORS; color++) {
+    world->color_starts[color + 1] = world->color_starts[color] + counts[color];
+    if (counts[color] > 0)
+      world->num_colors = color + 1;
+  }
+
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < world->num_joints; i++) {
+    color = world->joints[i].color;
+    sorted[world->color_starts[color] + counts[color]++] = world->joints[i];
+  }
+  memcpy(world->joints, sorted, sizeof(Joint) * world->num_joints);
+
+  mem_free(sorted);
+  mem_free(used);
+  world->joints_dirty = false;
+}
+
+// how far a body's points give way, per unit of push
+static float give(Body* body) {
+  if (body == NULL || body->type != BODY_DYNAMIC || body->mass <= 0.0)
+    return 0.0;
+  return body->num_points / body->mass;
+}
+
+// the deterministic pass is all float, with rsqrt, as edges are
+static void solve(Joint* joint, bool deterministic) {
+  Body* body1 = joint->body1;
+  Body* body2 = joint->body2;
+  float* point1 = body1->points[joint->point1];
+  float* point2 = (body2 != NULL)? body2->points[joint->point2] : joint->anchor;
+  float give1 = give(body1), give2 = give(body2);
+  float dx, dy, d2, inverse, push;
+
+  // rigid bodies would lose the push to their pose
+  if (body1->rigid || (body2 != NULL && body2->rigid)
+    || give1 + give2 == 0.0f)
+    return;
+
+  dx = point1[0] - point2[0];
+  dy = point1[1] - point2[1];
+  d2 = dx*dx + dy*dy;
+  if (d2 == 0.0f)
+    return;
+  inverse = deterministic? rsqrt(d2) : 1.0f / sqrtf(d2);
+  push = d2 * inverse - joint->length;
+  if (joint->type == JOINT_ROPE && push <= 0.0f)
+    return;
+  push *= joint->stiffness;
+
+  if (joint->type == JOINT_SPRING) {
+    float* last1 = body1->last_points[joint->point1];
+    float* last2 = body2->last_points[joint->point2];
+    float vx = (point1[0] - last1[0]) - (point2[0] - last2[0]);
+    float vy = (point1[1] - last1[1]) - (point2[1] - last2[1]);
+    push += joint->damping * (vx * dx + vy * dy) * inverse;
+  }
+
+  push *= inverse / (give1 + give2);
+  point1[0] -= dx * push * give1;
+  point1[1] -= dy * push * give1;
+  if (body2 != NULL) {
+    point2[0] += dx * push * give2;
+    point2[1] += dy * push * give2;
+  }
+}
+
+void joint_do_constraints(World* world) {
+  int color, i;
+  if (world->num_joints == 0)
+    return;
+  if (world->joints_dirty)
+    color_joints(world);
+
+  for (color = 0; color < world->num_colors; color++) {
+    for (i = world->color_starts[color]; i < world->color_starts[color + 1];
+      i++)
+      solve(&world->joints[i], world->deterministic);
+  }
+}
@@ -0,0 +1,92 @@
+/**
+ * Joints: constraints between points of different bodies, or between a
+ * point and a fixed place in the world. They let chains and bridges be
+ * built from many small bodies, each still collided on its own, rather
+ * than one big body.
+ * @author Scott LaVigne
+ */
+#ifndef JOINT_H
+#define JOINT_H
+
+#include <stdbool.h>
+
+#include "body.h"
+
+/**
+ * Most colors the joints are sorted into. Joints past the last color
+ * share it, and are solved in the order they were added.
+ */
+#define JOINT_COLORS 32
+
+/**
+ * What a joint holds
+ */
+typedef enum JointType {
+
+  JOINT_DISTANCE, // keeps its length, pushing and pulling
+  JOINT_ROPE,     // only pulls, when longer than its length
+  JOINT_SPRING,   // like a distance joint, but also damped
+  JOINT_PIN       // holds a point its length from an anchor
+
+} JointType;
+
+typedef struct Joint {
+
+  JointType type;
+  Body* body1;
+  int point1;  // index into body1's points
+  Body* body2; // NULL for a pin
+  int point2;
+  vec2 anchor; // where a pin holds its point
+  float length;
+  float stiffness; // fraction of the length error fixed each pass
+  float damping;   // fraction of the speed along it taken out each pass
+  int color;   // no two joints of a color share a point
+
+} Joint;
+
+/**
+ * Join a point of one body to a point of another at the distance
+ * they are now. Each point gives way in proportion to its share of
+ * its body's mass; static and kinematic bodies don't give way at all.
+ * A joint touching a rigid body does nothing until it is soft again,
+ * and bodies with joints keep full detail.
+ * @param  world     a world both bodies are in
+ * @param  type      JOINT_DISTANCE, JOINT_ROPE or JOINT_SPRING
+ * @param  body1     a body
+ * @param  point1    index of one of its points
+ * @param  body2     another body
+ * @param  point2    index of one of its points
+ * @param  stiffness fraction of the length error fixed each pass,
+ *                   1 for a rod
+ * @param  damping   for springs, fraction of the speed along the
+ *                   joint taken out each pass
+ * @return           true if the joint was added
+ */
+bool joint_add(World* world, JointType type, Body* body1, int point1,
+  Body* body2, int point2, float stiffness, float damping);
+
+/**
+ * Pin a point of a body to an anchor in the world, at the distance it
+ * is now. An anchor on the point holds it in place; one away from it
+ * swings it like a pendulum.
+ * @param  world     a world the body is in
+ * @param  body      a body
+ * @param  point     index of one of its points
+ * @param  anchor    where to hold it from
+ * @param  stiffness fraction of the length error fixed each pass
+ * @return           true if the pin was added
+ */
+bool joint_add_pin(World* world, Body* body, int point, vec2 anchor,
+  float stiffness);
+
+/**
+ * One pass over every joint in a world, a color at a time. The joints
+ * of a color touch disjoint points, so within a color the order they
+ * are solved in makes no difference. world_step runs this after each
+ * pass of edge constraints.
+ * @param world a world
+ */
+void joint_do_constraints(World* world);
+
+#endif /* JOINT_H */
@@ -3,6 +3,7 @@
  * @author Scott LaVigne
  */
 #include "list.h"
+#include "mem.h"
 
 typedef struct ListNode {
 
@@ -13,7 +14,7 @@ typedef struct ListNode {
 } ListNode;
 
 List* list_new() {
-  List* list = malloc(sizeof(List));
+  List* list = mem_alloc(MEM_LISTS, sizeof(List));
   list->length = 0;
   list->head = list->tail = NULL;
   return list;
@@ -24,17 +25,18 @@ void list_free(List* list) {
   ListNode* temp;
   while (node != NULL) {
     temp = node->next;
-    free(node);
+    mem_free(node);
     node = temp;
   }
-  free(list);
+  mem_free(list);
 }
 
 void list_push_back(List* list, void* data) {
   list->length++;
-  ListNode* node = malloc(sizeof(ListNode));
+  ListNode* node = mem_alloc(MEM_LISTS, sizeof(ListNode));
   node->data = data;
   node->next = NULL;
+  node->prev = NULL;
   if (list->tail != NULL) {
     node->prev = list->tail;
     list->tail->next = node;
@@ -56,16 +58,17 @@ void* list_pop_back(List* list) {
       list->head = list->tail = NULL;
     }
     data = node->data;
-    free(node);
+    mem_free(node);
   }
   return data;
 }
 
 void list_push_front(List* list, void* data) {
   list->length++;
-  ListNode* node = malloc(sizeof(ListNode));
+  ListNode* node = mem_alloc(MEM_LISTS, sizeof(ListNode));
   node->data = data;
   node->prev = NULL;
+  node->next = NULL;
   if (list->head != NULL) {
     node->next = list->head;
     list->head->prev = node;
@@ -88,7 +91,7 @@ void* list_pop_front(List* list) {
       list->tail = NULL;
     }
     data = node->data;
-    free(node);
+    mem_free(node);
   }
   return data;
 }
@@ -101,6 +104,27 @@ void* list_peek_front(List* list) {
   return list->head;
 }
 
+bool list_remove(List* list, void* data) {
+  ListNode* node = list->head;
+  while (node != NULL) {
+    if (node->data == data) {
+      if (node->prev != NULL)
+        node->prev->next = node->next;
+      else
+        list->head = node->next;
+      if (node->next != NULL)
+        node->next->prev = node->prev;
+      else
+        list->tail = node->prev;
+      list->length--;
+      mem_free(node);
+      return true;
+    }
+    node = node->next;
+  }
+  return false;
+}
+
 void list_traverse(List* list, bool(*fn)(void*, void*), void* data) {
   ListNode* node = list->head;
   while (node != NULL) {
@@ -66,6 +66,14 @@ void* list_peek_back(List* list);
  */
 void* list_peek_front(List* list);
 
+/**
+ * Remove the first occurrence of an element from the list.
+ * @param  list a list
+ * @param  data element to remove
+ * @return      true if the element was found
+ */
+bool list_remove(List* list, void* data);
+
 /**
  * Apply a function to every element in the list.
  * @param list a list
@@ -2,6 +2,8 @@
  * Useful maths: implementation
  * @author Scott LaVigne
  */
+#include <stdbool.h>
+
 #include "maths.h"
 
 float max(float a, float b) {
@@ -14,4 +16,24 @@ float min(float a, float b) {
 
 float clamp(float a, float min, float max) {
   return (a < min)? min : (a > max)? max : a;
-}
\ No newline at end of file
+}
+
+bool bbox_crossed(vec4 a, vec2 from, vec2 dir, float max_fraction) {
+  float near = 0.0, far = max_fraction;
+  int axis;
+
+  for (axis = 0; axis < 2; axis++) {
+    if (fabs(dir[axis]) < 1e-9) {
+      if (from[axis] < a[axis] || from[axis] > a[axis + 2])
+        return false;
+    } else {
+      float t1 = (a[axis] - from[axis]) / dir[axis];
+      float t2 = (a[axis + 2] - from[axis]) / dir[axis];
+      near = max(near, min(t1, t2));
+      far = min(far, max(t1, t2));
+      if (near > far)
+        return false;
+    }
+  }
+  return true;
+}
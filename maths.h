@@ -5,6 +5,10 @@
 #ifndef MATHS_H
 #define MATHS_H
 
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef float vec2[2];
 typedef float vec3[3];
 typedef float vec4[4];
@@ -13,8 +17,79 @@ typedef int vec2i[2];
 typedef int vec3i[3];
 typedef int vec4i[4];
 
+/**
+ * Fixed point with FIXED_BITS fractional bits. Sums of fixed point
+ * values are exact, so they come out the same in any order.
+ */
+#define FIXED_BITS 20
+typedef int64_t fixed;
+typedef fixed vec2x[2];
+
 float max(float a, float b);
 float min(float a, float b);
 float clamp(float a, float min, float max);
 
-#endif /* MATHS_H */
\ No newline at end of file
+/**
+ * Whether two bboxes, {min x, min y, max x, max y}, overlap. Touching
+ * counts.
+ * @param  a a bbox
+ * @param  b another bbox
+ * @return   true if they overlap
+ */
+static inline bool bbox_overlap(vec4 a, vec4 b) {
+  return a[0] <= b[2] && a[1] <= b[3] && a[2] >= b[0] && a[3] >= b[1];
+}
+
+/**
+ * Whether a segment crosses a bbox, by slabs.
+ * @param  a            a bbox
+ * @param  from         where the segment starts
+ * @param  dir          the segment, from its start to its end
+ * @param  max_fraction how far along dir to look, 1 for all of it
+ * @return              true if it crosses before max_fraction
+ */
+bool bbox_crossed(vec4 a, vec2 from, vec2 dir, float max_fraction);
+
+/**
+ * Round a float to fixed point
+ * @param  a a float
+ * @return   the nearest fixed point value
+ */
+static inline fixed fixed_from_float(float a) {
+  return (fixed) floor(a * (double) (1 << FIXED_BITS) + 0.5);
+}
+
+/**
+ * Convert fixed point to the nearest float
+ * @param  a fixed point value
+ * @return   a float
+ */
+static inline float fixed_to_float(fixed a) {
+  return a * (1.0 / (1 << FIXED_BITS));
+}
+
+/**
+ * Reciprocal square root from an integer estimate and three Newton
+ * steps. It uses only IEEE multiplies and subtracts in a fixed order,
+ * so it gives the same bits on every machine and in every SIMD lane,
+ * unlike hardware estimates. Inline, as are the fixed point
+ * conversions, so the loops calling it vectorise.
+ * @param  a a float
+ * @return   1/sqrt(a), or 0 if a isn't positive
+ */
+static inline float rsqrt(float a) {
+  union { float f; int32_t i; } u = {a};
+  float y;
+  u.i = 0x5f3759df - (u.i >> 1);
+  y = u.f;
+  y = y * (1.5f - 0.5f * a * y * y);
+  y = y * (1.5f - 0.5f * a * y * y);
+  y = y * (1.5f - 0.5f * a * y * y);
+  // zeroed with a mask rather than a branch, which would stop loops
+  // vectorising
+  u.f = y;
+  u.i &= -(int32_t) (a > 0.0f);
+  return u.f;
+}
+
+#endif /* MATHS_H */
@@ -0,0 +1,164 @@
+/**
+ * Memory accounting: implementation
+ * @author Scott LaVigne
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+// in front of every tracked block, padded to keep the block aligned as
+// malloc's would be
+typedef union MemHeader {
+  struct {
+    size_t size;
+    MemTag tag;
+  } block;
+  long double align;
+} MemHeader;
+
+static MemStats counters[MEM_TAGS];
+
+static const char* names[MEM_TAGS] = {
+  [MEM_BODIES] = "bodies",
+  [MEM_EDGES] = "edges",
+  [MEM_POINTS] = "points",
+  [MEM_CALLBACKS] = "callbacks",
+  [MEM_LISTS] = "lists",
+  [MEM_JOINTS] = "joints",
+  [MEM_PARTICLES] = "particles",
+  [MEM_WORLDS] = "worlds",
+  [MEM_SHADERS] = "shaders",
+  [MEM_GPU] = "gpu"
+};
+
+// raise a high-water mark to a value, if it is higher
+static void raise_peak(long* peak, long value) {
+  long seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+  while (value > seen && __atomic_compare_exchange_n(peak, &seen, value,
+    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+}
+
+// count bytes and blocks in or out of a tag
+static void count(MemTag tag, long bytes, long blocks) {
+  MemStats* stats = &counters[tag];
+  raise_peak(&stats->peak,
+    __atomic_add_fetch(&stats->bytes, bytes, __ATOMIC_RELAXED));
+  raise_peak(&stats->peak_blocks,
+    __atomic_add_fetch(&stats->blocks, blocks, __ATOMIC_RELAXED));
+  if (blocks > 0)
+    __atomic_add_fetch(&stats->allocations, blocks, __ATOMIC_RELAXED);
+}
+
+void* mem_alloc(MemTag tag, size_t size) {
+  MemHeader* header = malloc(sizeof(MemHeader) + size);
+  if (header == NULL)
+    return NULL;
+  header->block.size = size;
+  header->block.tag = tag;
+  count(tag, size, 1);
+  return header + 1;
+}
+
+void* mem_calloc(MemTag tag, size_t number, size_t size) {
+  void* ptr = mem_alloc(tag, number * size);
+  if (ptr != NULL)
+    memset(ptr, 0, number * size);
+  return ptr;
+}
+
+void* mem_realloc(MemTag tag, void* ptr, size_t size) {
+  MemHeader* header;
+  size_t old_size;
+  if (ptr == NULL)
+    return mem_alloc(tag, size);
+
+  header = (MemHeader*) ptr - 1;
+  old_size = header->block.size;
+  tag = header->block.tag;
+  header = realloc(header, sizeof(MemHeader) + size);
+  if (header == NULL)
+    return NULL;
+  header->block.size = size;
+  count(tag, (long) size - (long) old_size, 0);
+  return header + 1;
+}
+
+char* mem_strdup(MemTag tag, const char* string) {
+  size_t size = strlen(string) + 1;
+  char* copy = mem_alloc(tag, size);
+  memcpy(copy, string, size);
+  return copy;
+}
+
+void mem_free(void* ptr) {
+  MemHeader* header;
+  if (ptr == NULL)
+    return;
+  header = (MemHeader*) ptr - 1;
+  count(header->block.tag, -(long) header->block.size, -1);
+  free(header);
+}
+
+void mem_track(MemTag tag, long bytes) {
+  count(tag, bytes, (bytes > 0)? 1 : (bytes < 0)? -1 : 0);
+}
+
+void mem_get(MemTag tag, MemStats* stats) {
+  stats->bytes = __atomic_load_n(&counters[tag].bytes, __ATOMIC_RELAXED);
+  stats->peak = __atomic_load_n(&counters[tag].peak, __ATOMIC_RELAXED);
+  stats->blocks = __atomic_load_n(&counters[tag].blocks, __ATOMIC_RELAXED);
+  stats->peak_blocks =
+    __atomic_load_n(&counters[tag].peak_blocks, __ATOMIC_RELAXED);
+  stats->allocations =
+    __atomic_load_n(&counters[tag].allocations, __ATOMIC_RELAXED);
+}
+
+long mem_total() {
+  long total = 0;
+  int i;
+  for (i = 0; i < MEM_TAGS; i++)
+    total += __atomic_load_n(&counters[i].bytes, __ATOMIC_RELAXED);
+  return total;
+}
+
+void mem_report() {
+  MemStats stats[MEM_TAGS];
+  long body_bytes, body_peak;
+  bool leaks = false;
+  int i;
+
+  printf("%-10s %12s %12s %8s %8s %12s\n", "memory", "bytes", "peak",
+    "blocks", "peak", "allocations");
+  for (i = 0; i < MEM_TAGS; i++) {
+    mem_get(i, &stats[i]);
+    printf("%-10s %12ld %12ld %8ld %8ld %12ld\n", names[i], stats[i].bytes,
+      stats[i].peak, stats[i].blocks, stats[i].peak_blocks,
+      stats[i].allocations);
+  }
+
+  // a body is its struct, edges, points and callbacks; the peaks of
+  // the parts may not have come at once, so theirs is an upper bound
+  body_bytes = stats[MEM_BODIES].bytes + stats[MEM_EDGES].bytes
+    + stats[MEM_POINTS].bytes + stats[MEM_CALLBACKS].bytes;
+  body_peak = stats[MEM_BODIES].peak + stats[MEM_EDGES].peak
+    + stats[MEM_POINTS].peak + stats[MEM_CALLBACKS].peak;
+  if (stats[MEM_BODIES].blocks > 0)
+    printf("%ld bodies, %ld bytes each\n", stats[MEM_BODIES].blocks,
+      body_bytes / stats[MEM_BODIES].blocks);
+  else if (stats[MEM_BODIES].peak_blocks > 0)
+    printf("at most %ld bytes a body at the peak of %ld bodies\n",
+      body_peak / stats[MEM_BODIES].peak_blocks,
+      stats[MEM_BODIES].peak_blocks);
+
+  for (i = 0; i < MEM_TAGS; i++) {
+    if (stats[i].blocks != 0) {
+      printf("leaked: %ld bytes of %s in %ld blocks\n", stats[i].bytes,
+        names[i], stats[i].blocks);
+      leaks = true;
+    }
+  }
+  if (leaks == false)
+    printf("no leaks\n");
+}
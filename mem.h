@@ -0,0 +1,113 @@
+/**
+ * Memory accounting: allocations tagged by what they are for, with
+ * live bytes, high-water marks and a leak report per tag. Tracked
+ * blocks carry a small header, so they must be freed with mem_free and
+ * resized with mem_realloc. Counters are atomic, so worlds on other
+ * threads can allocate freely.
+ * @author Scott LaVigne
+ */
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * What memory is for
+ */
+typedef enum MemTag {
+
+  MEM_BODIES,    // Body structs, one block each
+  MEM_EDGES,
+  MEM_POINTS,    // point pools and per-point body arrays
+  MEM_CALLBACKS, // collision callbacks
+  MEM_LISTS,     // lists and their nodes
+  MEM_JOINTS,
+  MEM_PARTICLES, // the debris pool
+  MEM_WORLDS,    // worlds and their broadphase scratch
+  MEM_SHADERS,   // shader sources, pipelines and their reflection
+  MEM_GPU,       // buffer objects, counted with mem_track
+
+  MEM_TAGS
+
+} MemTag;
+
+typedef struct MemStats {
+
+  long bytes;      // live now
+  long peak;       // most bytes live at once
+  long blocks;     // live now
+  long peak_blocks; // most blocks live at once
+  long allocations; // ever made
+
+} MemStats;
+
+/**
+ * Allocate tracked memory.
+ * @param  tag  what it is for
+ * @param  size bytes
+ * @return      the memory, or NULL
+ */
+void* mem_alloc(MemTag tag, size_t size);
+
+/**
+ * Allocate tracked memory, zeroed.
+ * @param  tag    what it is for
+ * @param  number number of elements
+ * @param  size   bytes per element
+ * @return        the memory, or NULL
+ */
+void* mem_calloc(MemTag tag, size_t number, size_t size);
+
+/**
+ * Resize tracked memory, keeping its tag.
+ * @param  tag  what it is for, used if ptr is NULL
+ * @param  ptr  tracked memory, or NULL to allocate
+ * @param  size bytes
+ * @return      the memory, which may have moved, or NULL
+ */
+void* mem_realloc(MemTag tag, void* ptr, size_t size);
+
+/**
+ * Copy a string into tracked memory.
+ * @param  tag    what it is for
+ * @param  string a string
+ * @return        the copy
+ */
+char* mem_strdup(MemTag tag, const char* string);
+
+/**
+ * Free tracked memory.
+ * @param ptr tracked memory, or NULL
+ */
+void mem_free(void* ptr);
+
+/**
+ * Count memory held somewhere else, like a buffer object on the GPU,
+ * as a block of a tag.
+ * @param tag   what it is for
+ * @param bytes bytes taken, or negative for bytes given back
+ */
+void mem_track(MemTag tag, long bytes);
+
+/**
+ * Get the counters of a tag.
+ * @param tag   a tag
+ * @param stats filled with its counters
+ */
+void mem_get(MemTag tag, MemStats* stats);
+
+/**
+ * Get the bytes live under every tag.
+ * @return the total
+ */
+long mem_total();
+
+/**
+ * Print every tag's counters, the bytes a body takes on average with
+ * its edges, points and callbacks, and any tag with blocks still live
+ * as a leak. Fit for atexit.
+ */
+void mem_report();
+
+#endif /* MEM_H */
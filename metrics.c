@@ -0,0 +1,386 @@
+/**
+ * Runtime counters and timings, drawn as an overlay and dumped to a
+ * file once a second: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <GL/glew.h>
+
+#include "metrics.h"
+#include "maths.h"
+#include "mem.h"
+#include "shader.h"
+
+extern Pipeline* body_program;
+
+typedef enum MetricKind {
+
+  METRIC_GAUGE,
+  METRIC_COUNTER,
+  METRIC_TIMER
+
+} MetricKind;
+
+typedef struct Metric {
+
+  const char* name;
+  MetricKind kind;
+  vec3 color;      // overlay row color
+
+  double frame;    // this frame's value
+  double second;   // sum over this second, the last value for gauges
+  double max;      // largest timer sample this second
+  unsigned samples;                  // timer samples this second
+  unsigned buckets[METRICS_BUCKETS]; // timer histogram this second
+  float history[METRICS_HISTORY];    // value of recent frames
+
+} Metric;
+
+static Metric metrics[METRIC_COUNT] = {
+  [METRIC_BODIES] = {.name = "bodies", .kind = METRIC_GAUGE,
+    .color = {0.6, 0.6, 1.0}},
+  [METRIC_POINTS] = {.name = "points", .kind = METRIC_GAUGE,
+    .color = {0.6, 0.6, 1.0}},
+  [METRIC_EDGES] = {.name = "edges", .kind = METRIC_GAUGE,
+    .color = {0.6, 0.6, 1.0}},
+  [METRIC_PARTICLES] = {.name = "particles", .kind = METRIC_GAUGE,
+    .color = {0.6, 0.6, 1.0}},
+  [METRIC_MEMORY] = {.name = "memory_kb", .kind = METRIC_GAUGE,
+    .color = {0.6, 0.6, 1.0}},
+  [METRIC_TICKS] = {.name = "ticks", .kind = METRIC_COUNTER,
+    .color = {1.0, 1.0, 0.5}},
+  [METRIC_ITERATIONS] = {.name = "iterations", .kind = METRIC_COUNTER,
+    .color = {1.0, 1.0, 0.5}},
+  [METRIC_PAIRS] = {.name = "pairs", .kind = METRIC_COUNTER,
+    .color = {1.0, 0.7, 0.3}},
+  [METRIC_HITS] = {.name = "hits", .kind = METRIC_COUNTER,
+    .color = {1.0, 0.7, 0.3}},
+  [METRIC_CONTACTS] = {.name = "contacts", .kind = METRIC_COUNTER,
+    .color = {1.0, 0.7, 0.3}},
+  [METRIC_ROLLBACK_TICKS] = {.name = "rollback_ticks",
+    .kind = METRIC_COUNTER, .color = {1.0, 0.4, 0.4}},
+  [METRIC_FRAME_TIME] = {.name = "frame_time", .kind = METRIC_TIMER,
+    .color = {0.4, 1.0, 0.4}},
+  [METRIC_PHYSICS_TIME] = {.name = "physics_time", .kind = METRIC_TIMER,
+    .color = {0.4, 1.0, 0.4}},
+  [METRIC_COLLIDE_TIME] = {.name = "collide_time", .kind = METRIC_TIMER,
+    .color = {0.4, 1.0, 0.4}},
+  [METRIC_RENDER_TIME] = {.name = "render_time", .kind = METRIC_TIMER,
+    .color = {0.4, 1.0, 0.4}},
+  [METRIC_ROLLBACK_TIME] = {.name = "rollback_time", .kind = METRIC_TIMER,
+    .color = {1.0, 0.4, 0.4}},
+  [METRIC_PARTICLE_TIME] = {.name = "particle_time", .kind = METRIC_TIMER,
+    .color = {0.4, 1.0, 0.4}},
+};
+
+static unsigned num_frames;
+static double start_time;   // of the first frame
+static double second_start; // of the current second
+static FILE* dump_file;
+static bool dump_json;
+static bool overlay;
+
+// overlay geometry, drawn as lines with the body pipeline
+static unsigned overlay_vbo;
+static int overlay_vbo_capacity; // vertices the buffer holds
+static vec2* overlay_coords;
+static vec3* overlay_colors;
+static int overlay_count;
+static int overlay_capacity;
+
+void metrics_add(MetricId id, double amount) {
+  metrics[id].frame += amount;
+}
+
+void metrics_set(MetricId id, double value) {
+  metrics[id].frame = value;
+}
+
+void metrics_time(MetricId id, double seconds) {
+  Metric* metric = &metrics[id];
+  int bucket = 0;
+  double us = seconds * 1e6;
+
+  while (us >= 2.0 && bucket < METRICS_BUCKETS - 1) {
+    us *= 0.5;
+    bucket++;
+  }
+  metric->frame += seconds;
+  metric->buckets[bucket]++;
+  metric->samples++;
+  metric->max = max(metric->max, seconds);
+}
+
+double metrics_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// a percentile of a timer's samples this second, interpolated within
+// its bucket
+static double percentile(Metric* metric, double fraction) {
+  double wanted = fraction * metric->samples, seen = 0.0;
+  int i;
+
+  for (i = 0; i < METRICS_BUCKETS; i++) {
+    double low = (i == 0)? 0.0 : ldexp(1.0, i);
+    double high = ldexp(1.0, i + 1);
+    if (seen + metric->buckets[i] >= wanted && metric->buckets[i] > 0) {
+      double t = (wanted - seen) / metric->buckets[i];
+      return min(low + (high - low) * t, metric->max * 1e6) * 1e-6;
+    }
+    seen += metric->buckets[i];
+  }
+  return metric->max;
+}
+
+static void write_row(double time) {
+  int i;
+
+  if (dump_json) {
+    fprintf(dump_file, "{\"time\": %.3f", time);
+  } else {
+    fprintf(dump_file, "%.3f", time);
+  }
+
+  for (i = 0; i < METRIC_COUNT; i++) {
+    Metric* metric = &metrics[i];
+    if (metric->kind != METRIC_TIMER) {
+      if (dump_json)
+        fprintf(dump_file, ", \"%s\": %.0f", metric->name, metric->second);
+      else
+        fprintf(dump_file, ",%.0f", metric->second);
+    } else {
+      double mean = (metric->samples > 0)?
+        metric->second / metric->samples : 0.0;
+      double p50 = percentile(metric, 0.5);
+      double p99 = percentile(metric, 0.99);
+      if (dump_json)
+        fprintf(dump_file, ", \"%s\": {\"mean\": %.3f, \"p50\": %.3f, "
+          "\"p99\": %.3f, \"max\": %.3f}", metric->name, mean * 1e3,
+          p50 * 1e3, p99 * 1e3, metric->max * 1e3);
+      else
+        fprintf(dump_file, ",%.3f,%.3f,%.3f,%.3f", mean * 1e3, p50 * 1e3,
+          p99 * 1e3, metric->max * 1e3);
+    }
+  }
+
+  fprintf(dump_file, dump_json? "}\n" : "\n");
+  fflush(dump_file);
+}
+
+void metrics_frame() {
+  double now = metrics_now();
+  int i;
+
+  if (num_frames == 0)
+    start_time = second_start = now;
+
+  for (i = 0; i < METRIC_COUNT; i++) {
+    Metric* metric = &metrics[i];
+    metric->history[num_frames % METRICS_HISTORY] = metric->frame;
+    if (metric->kind == METRIC_GAUGE) {
+      metric->second = metric->frame;
+    } else {
+      metric->second += metric->frame;
+      metric->frame = 0.0;
+    }
+  }
+  num_frames++;
+
+  if (now - second_start < 1.0)
+    return;
+
+  if (dump_file != NULL)
+    write_row(now - start_time);
+  for (i = 0; i < METRIC_COUNT; i++) {
+    Metric* metric = &metrics[i];
+    metric->second = 0.0;
+    metric->max = 0.0;
+    metric->samples = 0;
+    memset(metric->buckets, 0, sizeof(metric->buckets));
+  }
+  second_start = now;
+}
+
+bool metrics_dump(const char* path) {
+  const char* dot = strrchr(path, '.');
+  int i;
+
+  if (dump_file != NULL)
+    fclose(dump_file);
+  dump_file = fopen(path, "w");
+  if (dump_file == NULL) {
+    printf("Unable to open metrics file %s\n", path);
+    return false;
+  }
+
+  dump_json = dot != NULL && strcmp(dot, ".json") == 0;
+  if (dump_json)
+    return true;
+
+  // csv header, timers get four columns in milliseconds
+  fprintf(dump_file, "time");
+  for (i = 0; i < METRIC_COUNT; i++) {
+    if (metrics[i].kind != METRIC_TIMER)
+      fprintf(dump_file, ",%s", metrics[i].name);
+    else
+      fprintf(dump_file, ",%s_mean,%s_p50,%s_p99,%s_max", metrics[i].name,
+        metrics[i].name, metrics[i].name, metrics[i].name);
+  }
+  fprintf(dump_file, "\n");
+  return true;
+}
+
+void metrics_set_overlay(bool show) {
+  overlay = show;
+}
+
+bool metrics_overlay() {
+  return overlay;
+}
+
+static void add_line(float x1, float y1, float x2, float y2, vec3 color) {
+  int i;
+  if (overlay_count + 2 > overlay_capacity) {
+    overlay_capacity = (overlay_capacity > 0)? overlay_capacity * 2 : 1024;
+    overlay_coords = realloc(overlay_coords, sizeof(vec2) * overlay_capacity);
+    overlay_colors = realloc(overlay_colors, sizeof(vec3) * overlay_capacity);
+  }
+  overlay_coords[overlay_count][0] = x1;
+  overlay_coords[overlay_count][1] = y1;
+  overlay_coords[overlay_count + 1][0] = x2;
+  overlay_coords[overlay_count + 1][1] = y2;
+  for (i = 0; i < 2; i++)
+    memcpy(overlay_colors[overlay_count + i], color, sizeof(vec3));
+  overlay_count += 2;
+}
+
+// seven segment glyphs, bit 0 is the top segment then clockwise,
+// bit 6 the middle
+static const unsigned char digits[10] = {
+  0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+};
+
+// draw a number with its top left at x, y. Returns the x after it.
+static float add_text(const char* text, float x, float y, vec3 color) {
+  const float w = 6.0, h = 10.0, m = h * 0.5;
+
+  for (; *text; text++) {
+    unsigned char segments;
+    if (*text == '.') {
+      add_line(x, y - h, x + 1.0, y - h, color);
+      x += 4.0;
+      continue;
+    }
+    segments = (*text == '-')? 0x40
+      : (*text >= '0' && *text <= '9')? digits[*text - '0'] : 0;
+
+    if (segments & 0x01) add_line(x, y, x + w, y, color);
+    if (segments & 0x02) add_line(x + w, y, x + w, y - m, color);
+    if (segments & 0x04) add_line(x + w, y - m, x + w, y - h, color);
+    if (segments & 0x08) add_line(x, y - h, x + w, y - h, color);
+    if (segments & 0x10) add_line(x, y - m, x, y - h, color);
+    if (segments & 0x20) add_line(x, y, x, y - m, color);
+    if (segments & 0x40) add_line(x, y - m, x + w, y - m, color);
+    x += w + 3.0;
+  }
+  return x;
+}
+
+void metrics_render(int width, int height) {
+  const float graph_height = 60.0, budget = 1000.0 / 60.0;
+  vec3 gray = {0.4, 0.4, 0.4}, green = {0.3, 0.9, 0.3}, red = {1.0, 0.3, 0.3};
+  vec2 scale = {2.0 / width, 2.0 / height}, offset = {-1.0, -1.0};
+  float left = 10.0, top = height - 10.0, y;
+  char text[32];
+  int i;
+
+  if (overlay == false || num_frames == 0)
+    return;
+  overlay_count = 0;
+
+  // frame times, scaled so the 60Hz budget is halfway up
+  add_line(left, top - graph_height, left + 2 * METRICS_HISTORY,
+    top - graph_height, gray);
+  add_line(left, top - graph_height * 0.5, left + 2 * METRICS_HISTORY,
+    top - graph_height * 0.5, gray);
+  for (i = 0; i < METRICS_HISTORY && i < (int) num_frames; i++) {
+    // oldest first; num_frames is unsigned, so don't subtract from it
+    int frame = (num_frames >= METRICS_HISTORY)?
+      (int) ((num_frames + i) % METRICS_HISTORY) : i;
+    float ms = metrics[METRIC_FRAME_TIME].history[frame] * 1e3;
+    float x = left + 2 * i;
+    add_line(x, top - graph_height,
+      x, top - graph_height * (1.0 - min(ms / (2.0 * budget), 1.0)),
+      (ms <= budget + 0.5)? green : red);
+  }
+
+  // last frame's value of every metric, one per row
+  y = top - graph_height - 8.0;
+  for (i = 0; i < METRIC_COUNT; i++) {
+    Metric* metric = &metrics[i];
+    float value = metric->history[(num_frames - 1) % METRICS_HISTORY];
+    if (metric->kind == METRIC_TIMER)
+      snprintf(text, sizeof(text), "%.2f", value * 1e3);
+    else
+      snprintf(text, sizeof(text), "%.0f", value);
+    add_text(text, left, y, metric->color);
+    y -= 14.0;
+  }
+
+  // the buffer grows with the line arrays, colors after every coord
+  if (overlay_vbo == 0)
+    glGenBuffers(1, &overlay_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+  if (overlay_vbo_capacity < overlay_capacity) {
+    if (overlay_vbo_capacity > 0)
+      mem_track(MEM_GPU, -(long) ((sizeof(vec2) + sizeof(vec3))
+        * overlay_vbo_capacity));
+    overlay_vbo_capacity = overlay_capacity;
+    glBufferData(GL_ARRAY_BUFFER,
+      (sizeof(vec2) + sizeof(vec3)) * overlay_vbo_capacity, NULL,
+      GL_STREAM_DRAW);
+    mem_track(MEM_GPU, (sizeof(vec2) + sizeof(vec3)) * overlay_vbo_capacity);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec2) * overlay_count,
+    overlay_coords);
+  glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec2) * overlay_vbo_capacity,
+    sizeof(vec3) * overlay_count, overlay_colors);
+
+  // draw in window pixels instead of world units
+  pipeline_uniform(body_program, "scale", scale, sizeof(vec2));
+  pipeline_uniform(body_program, "offset", offset, sizeof(vec2));
+  if (pipeline_use(body_program) == false)
+    return;
+  glVertexAttribPointer(pipeline_attribute(body_program, "coord"), 2, GL_FLOAT,
+    false, 0, (void*)(0));
+  glVertexAttribPointer(pipeline_attribute(body_program, "color"), 3, GL_FLOAT,
+    false, 0, (void*)(sizeof(vec2) * overlay_vbo_capacity));
+  glDrawArrays(GL_LINES, 0, overlay_count);
+}
+
+void metrics_free() {
+  if (dump_file != NULL)
+    fclose(dump_file);
+  dump_file = NULL;
+  if (overlay_vbo != 0) {
+    glDeleteBuffers(1, &overlay_vbo);
+    if (overlay_vbo_capacity > 0)
+      mem_track(MEM_GPU, -(long) ((sizeof(vec2) + sizeof(vec3))
+        * overlay_vbo_capacity));
+  }
+  overlay_vbo = 0;
+  overlay_vbo_capacity = 0;
+  free(overlay_coords);
+  free(overlay_colors);
+  overlay_coords = NULL;
+  overlay_colors = NULL;
+  overlay_count = overlay_capacity = 0;
+}
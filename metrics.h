@@ -0,0 +1,125 @@
+/**
+ * Runtime counters and timings, drawn as an overlay and dumped to a
+ * file once a second
+ * @author Scott LaVigne
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+
+/**
+ * Frames of history kept for the overlay graph
+ */
+#define METRICS_HISTORY 120
+
+/**
+ * Timer histogram buckets. Bucket i holds samples from 2^i to 2^(i+1)
+ * microseconds, the last one everything longer.
+ */
+#define METRICS_BUCKETS 20
+
+/**
+ * Everything measured. The overlay lists them in this order, one row
+ * each, in the color given in metrics.c.
+ */
+typedef enum MetricId {
+
+  // gauges, the last value set in a frame
+  METRIC_BODIES,
+  METRIC_POINTS,
+  METRIC_EDGES,
+  METRIC_PARTICLES,
+  METRIC_MEMORY,     // kilobytes live, see mem.h
+
+  // counters, summed over a frame
+  METRIC_TICKS,      // physics ticks run
+  METRIC_ITERATIONS, // edge constraint passes over a body
+  METRIC_PAIRS,      // pairs the broadphase turned up
+  METRIC_HITS,       // pairs the narrowphase found touching
+  METRIC_CONTACTS,   // contacts resolved
+  METRIC_ROLLBACK_TICKS, // ticks stepped again after a netplay rollback
+
+  // timers, in seconds, summed over a frame and kept in a histogram
+  METRIC_FRAME_TIME,   // between the starts of two frames
+  METRIC_PHYSICS_TIME, // every tick in a frame
+  METRIC_COLLIDE_TIME, // collision passes in a frame
+  METRIC_RENDER_TIME,  // drawing a frame
+  METRIC_ROLLBACK_TIME, // netplay rollbacks in a frame
+  METRIC_PARTICLE_TIME, // stepping debris in a frame
+
+  METRIC_COUNT
+
+} MetricId;
+
+/**
+ * Add to a counter or timer.
+ * @param id     a counter
+ * @param amount how much to add
+ */
+void metrics_add(MetricId id, double amount);
+
+/**
+ * Set a gauge.
+ * @param id    a gauge
+ * @param value its value
+ */
+void metrics_set(MetricId id, double value);
+
+/**
+ * Record a timing. Each call is one histogram sample.
+ * @param id      a timer
+ * @param seconds how long it took
+ */
+void metrics_time(MetricId id, double seconds);
+
+/**
+ * Get a monotonic time for timing phases.
+ * @return seconds since an arbitrary point
+ */
+double metrics_now();
+
+/**
+ * Finish a frame: push this frame's values into the history, and
+ * once a second write a row to the dump file. Call once per frame.
+ */
+void metrics_frame();
+
+/**
+ * Start writing a row of metrics to a file every second. A path
+ * ending in .json gets one JSON object per line, anything else CSV
+ * with a header.
+ * @param  path file path to write
+ * @return      true if the file could be opened
+ */
+bool metrics_dump(const char* path);
+
+/**
+ * Show or hide the overlay.
+ * @param show true to show it
+ */
+void metrics_set_overlay(bool show);
+
+/**
+ * Whether the overlay is shown.
+ * @return true if it is
+ */
+bool metrics_overlay();
+
+/**
+ * Draw the overlay in the top left of the window: a graph of frame
+ * times against the 60Hz budget, then a row of digits per metric.
+ * Timers are shown in milliseconds. Uses the body pipeline, and
+ * leaves its view uniforms set for the window rather than the camera.
+ * @param width  window width in pixels
+ * @param height window height in pixels
+ */
+void metrics_render(int width, int height);
+
+/**
+ * Close the dump file and free the overlay's buffers. Metrics can
+ * still be counted after, and the overlay drawn again.
+ */
+void metrics_free();
+
+#endif /* METRICS_H */
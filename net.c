@@ -0,0 +1,247 @@
+/**
+ * Two players stepping one world in two processes: implementation
+ * @author Scott LaVigne
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <GL/freeglut.h>
+
+#include "net.h"
+
+const int net_keys[NET_PLAYERS][NET_BUTTONS] = {
+  {WORLD_SPECIAL(GLUT_KEY_UP), WORLD_SPECIAL(GLUT_KEY_DOWN),
+    WORLD_SPECIAL(GLUT_KEY_LEFT), WORLD_SPECIAL(GLUT_KEY_RIGHT)},
+  {'w', 's', 'a', 'd'}
+};
+
+// frames of history kept
+#define NET_FRAMES (NET_MAX_ROLLBACK + 1)
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Net* net_new(World* world, int player, int port, const char* peer_host,
+  int peer_port, int input_delay)
+{
+  Net* net;
+  struct sockaddr_in local;
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    printf("Could not create a socket\n");
+    return NULL;
+  }
+
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr*) &local, sizeof(local)) < 0) {
+    printf("Could not bind UDP port %d\n", port);
+    close(fd);
+    return NULL;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  net = calloc(1, sizeof(Net));
+  net->peer.sin_family = AF_INET;
+  net->peer.sin_port = htons(peer_port);
+  if (inet_pton(AF_INET, peer_host, &net->peer.sin_addr) != 1) {
+    printf("Could not parse peer address %s\n", peer_host);
+    close(fd);
+    free(net);
+    return NULL;
+  }
+
+  net->world = world;
+  net->player = player;
+  net->socket = fd;
+  if (input_delay > NET_MAX_ROLLBACK)
+    input_delay = NET_MAX_ROLLBACK;
+  net->input_delay = (input_delay > 0)? input_delay : 0;
+  // the first ticks are stepped before any input, with none
+  net->local_count = net->input_delay;
+  net->history = snapshot_history_new(world, NET_FRAMES, NULL, 0);
+  world->deterministic = true;
+  return net;
+}
+
+void net_free(Net* net) {
+  close(net->socket);
+  snapshot_history_free(net->history);
+  free(net);
+}
+
+void net_set_state(Net* net, void* state, size_t size) {
+  net->state = state;
+  net->state_size = size;
+  snapshot_history_free(net->history);
+  net->history = snapshot_history_new(net->world, NET_FRAMES, state, size);
+}
+
+// a player's input at a tick: real if it has arrived, otherwise the
+// last real input is the prediction
+static uint8_t input(Net* net, int player, unsigned tick) {
+  if (player == net->player)
+    return (tick < net->local_count)? net->local[tick % NET_WINDOW] : 0;
+  if (tick < net->remote_count)
+    return net->remote[tick % NET_WINDOW];
+  return (net->remote_count > 0)?
+    net->remote[(net->remote_count - 1) % NET_WINDOW] : 0;
+}
+
+// save the state at the start of a tick, then step it with every
+// player's input on their keys. The keys are put back after, they
+// belong to the keyboard between steps.
+static void step(Net* net, unsigned tick) {
+  World* world = net->world;
+  bool held[NET_PLAYERS][NET_BUTTONS];
+  bool pressed[NET_PLAYERS][NET_BUTTONS];
+  bool released[NET_PLAYERS][NET_BUTTONS];
+  int p, b;
+
+  snapshot_history_push(net->history);
+
+  for (p = 0; p < NET_PLAYERS; p++) {
+    uint8_t bits = input(net, p, tick);
+    uint8_t last = (tick > 0)? input(net, p, tick - 1) : 0;
+    for (b = 0; b < NET_BUTTONS; b++) {
+      int key = net_keys[p][b];
+      bool down = (bits >> b) & 1, was = (last >> b) & 1;
+      held[p][b] = world->key_held[key];
+      pressed[p][b] = world->key_pressed[key];
+      released[p][b] = world->key_released[key];
+      world->key_held[key] = down;
+      world->key_pressed[key] = down && !was;
+      world->key_released[key] = was && !down;
+    }
+  }
+  net->stepped[tick % NET_WINDOW] = input(net, 1 - net->player, tick);
+  world_step(world);
+
+  for (p = 0; p < NET_PLAYERS; p++) {
+    for (b = 0; b < NET_BUTTONS; b++) {
+      world->key_held[net_keys[p][b]] = held[p][b];
+      world->key_pressed[net_keys[p][b]] = pressed[p][b];
+      world->key_released[net_keys[p][b]] = released[p][b];
+    }
+  }
+}
+
+// go back to a tick whose prediction was wrong and step up to now
+static void rollback(Net* net, unsigned tick) {
+  double start = now(), time;
+  unsigned t;
+
+  // the rewound frames are pushed again as the ticks are stepped
+  snapshot_history_rewind(net->history, net->tick - 1 - tick);
+  for (t = tick; t < net->tick; t++)
+    step(net, t);
+
+  time = now() - start;
+  net->stats.rollbacks++;
+  net->stats.rollback_ticks += net->tick - tick;
+  net->stats.rollback_time += time;
+  if (time > net->stats.rollback_worst)
+    net->stats.rollback_worst = time;
+}
+
+static void send_input(Net* net) {
+  NetPacket packet;
+  unsigned t;
+
+  packet.magic = NET_MAGIC;
+  packet.ack = net->remote_count;
+  packet.first = net->remote_ack;
+  packet.count = net->local_count - net->remote_ack;
+  for (t = 0; t < packet.count; t++)
+    packet.inputs[t] = net->local[(packet.first + t) % NET_WINDOW];
+
+  // a dropped packet is covered by the next one
+  if (sendto(net->socket, &packet,
+    offsetof(NetPacket, inputs) + packet.count, 0,
+    (struct sockaddr*) &net->peer, sizeof(net->peer)) >= 0)
+    net->stats.packets_sent++;
+}
+
+// take in every packet waiting, and roll back to the first tick the
+// new input shows was predicted wrong
+static void receive_input(Net* net) {
+  NetPacket packet;
+  unsigned wrong = net->tick, t;
+  ssize_t size;
+
+  while ((size = recv(net->socket, &packet, sizeof(packet), 0)) >= 0) {
+    if ((size_t) size < offsetof(NetPacket, inputs)
+      || packet.magic != NET_MAGIC || packet.count > NET_WINDOW
+      || (size_t) size != offsetof(NetPacket, inputs) + packet.count)
+      continue;
+    net->stats.packets_received++;
+    if (packet.ack > net->remote_ack && packet.ack <= net->local_count)
+      net->remote_ack = packet.ack;
+
+    // input only arrives in order, anything past a gap comes again
+    for (t = packet.first; t < packet.first + packet.count; t++) {
+      if (t != net->remote_count)
+        continue;
+      net->remote[t % NET_WINDOW] = packet.inputs[t - packet.first];
+      if (t < net->tick && t < wrong
+        && net->stepped[t % NET_WINDOW] != packet.inputs[t - packet.first])
+        wrong = t;
+      net->remote_count++;
+    }
+  }
+
+  if (wrong < net->tick)
+    rollback(net, wrong);
+}
+
+bool net_tick(Net* net) {
+  World* world = net->world;
+  uint8_t bits = 0;
+  int b;
+
+  receive_input(net);
+
+  // too far ahead of the peer, or of what it has acknowledged
+  if (net->tick >= net->remote_count + NET_MAX_ROLLBACK
+    || net->local_count + 1 > net->remote_ack + NET_WINDOW)
+  {
+    send_input(net);
+    net->stats.stalls++;
+    return false;
+  }
+
+  for (b = 0; b < NET_BUTTONS; b++)
+    if (world->key_held[net_keys[net->player][b]])
+      bits |= 1 << b;
+  net->local[net->local_count++ % NET_WINDOW] = bits;
+  send_input(net);
+
+  step(net, net->tick++);
+  net->stats.ticks++;
+  return true;
+}
+
+bool net_settle(Net* net, double timeout) {
+  double end = now() + timeout;
+  struct timespec ts = {0, 500000};
+
+  while (now() < end) {
+    receive_input(net);
+    send_input(net);
+    if (net->remote_count >= net->tick && net->remote_ack >= net->tick)
+      return true;
+    nanosleep(&ts, NULL);
+  }
+  return net->remote_count >= net->tick;
+}
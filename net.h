@@ -0,0 +1,160 @@
+/**
+ * Two players stepping one world in two processes. Only each tick's
+ * input crosses the network, over UDP. A peer's input that hasn't
+ * arrived yet is predicted to be the same as its last, and when the
+ * real input turns out different the world is rolled back to that
+ * tick from a snapshot and stepped forward again.
+ * @author Scott LaVigne
+ */
+#ifndef NET_H
+#define NET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "world.h"
+#include "snapshot.h"
+
+#define NET_PLAYERS 2
+
+/**
+ * Input bits, one per button
+ */
+#define NET_UP    0x01
+#define NET_DOWN  0x02
+#define NET_LEFT  0x04
+#define NET_RIGHT 0x08
+#define NET_BUTTONS 4
+
+/**
+ * Most ticks stepped on a prediction. A peer this far ahead of the
+ * other's input waits for it.
+ */
+#define NET_MAX_ROLLBACK 8
+
+/**
+ * Ticks of input kept, and the most sent in one packet
+ */
+#define NET_WINDOW 128
+
+#define NET_MAGIC 0x544e504a // "JPNT"
+
+/**
+ * Keystate indices a player's input bits stand for, in bit order.
+ * Player 0 has the arrow keys, player 1 W S A D.
+ */
+extern const int net_keys[NET_PLAYERS][NET_BUTTONS];
+
+/**
+ * Every packet: the sender's input from the first tick the receiver
+ * is missing on, so a lost packet is covered by the next one
+ */
+typedef struct NetPacket {
+
+  uint32_t magic;
+  uint32_t ack;   // ticks of the receiver's input the sender has
+  uint32_t first; // tick of inputs[0]
+  uint32_t count;
+  uint8_t inputs[NET_WINDOW];
+
+} NetPacket;
+
+/**
+ * Counts of the work done. Nothing resets them but the owner.
+ */
+typedef struct NetStats {
+
+  unsigned ticks;          // ticks stepped for the first time
+  unsigned stalls;         // calls that waited on the peer
+  unsigned rollbacks;
+  unsigned rollback_ticks; // ticks stepped again
+  double rollback_time;    // seconds spent rolling back and stepping again
+  double rollback_worst;   // longest single rollback
+  unsigned packets_sent;
+  unsigned packets_received;
+
+} NetStats;
+
+typedef struct Net {
+
+  World* world;
+  int player;      // which player is local
+  int input_delay; // ticks local input waits before it is stepped
+  int socket;
+  struct sockaddr_in peer;
+
+  unsigned tick;                 // next tick to step
+  uint8_t local[NET_WINDOW];     // local input by tick
+  unsigned local_count;          // ticks of local input known
+  uint8_t remote[NET_WINDOW];    // the peer's input by tick
+  unsigned remote_count;         // ticks of the peer's input arrived
+  unsigned remote_ack;           // ticks of local input the peer has
+  uint8_t stepped[NET_WINDOW];   // the peer's input each tick was
+                                 // stepped with, real or predicted
+
+  // the world and game state at the start of each of the last
+  // NET_MAX_ROLLBACK + 1 ticks, the newest frame at tick - 1
+  SnapshotHistory* history;
+  void* state; // game state rolled back with the world
+  size_t state_size;
+
+  NetStats stats;
+
+} Net;
+
+/**
+ * Start a session. Its world is made deterministic, so both peers
+ * step it to the same bits.
+ * @param  world       the world both peers step, set up the same way
+ * @param  player      the local player, 0 or 1
+ * @param  port        local UDP port
+ * @param  peer_host   the peer's IPv4 address, e.g. "127.0.0.1"
+ * @param  peer_port   the peer's UDP port
+ * @param  input_delay ticks local input waits before it is stepped.
+ *                     More delay means fewer rollbacks.
+ * @return             a new session, or NULL if the socket couldn't
+ *                     be set up
+ */
+Net* net_new(World* world, int player, int port, const char* peer_host,
+  int peer_port, int input_delay);
+
+/**
+ * Close a session. The world is untouched.
+ * @param net a session
+ */
+void net_free(Net* net);
+
+/**
+ * Have some game state rolled back with the world. It must not hold
+ * pointers that stepping changes.
+ * @param net   a session
+ * @param state the state
+ * @param size  its size in bytes
+ */
+void net_set_state(Net* net, void* state, size_t size);
+
+/**
+ * Step the world one tick. The local player's input is read from
+ * their keys in the world's keystate, and each player's input is
+ * put on their keys for every step, rolled back ones included, then
+ * the keystate is put back as it was.
+ * Packets are sent and received, and the world is rolled back first
+ * if the peer's input proved a prediction wrong.
+ * @param  net a session
+ * @return     true if it stepped, false if it is waiting on the peer
+ */
+bool net_tick(Net* net);
+
+/**
+ * Stop stepping and wait for the peer's input to every tick stepped,
+ * rolling back as needed, so the world is final. Then keep sending
+ * until the peer has every local input, or the time runs out.
+ * @param  net     a session
+ * @param  timeout seconds to wait at most
+ * @return         true if the world is final
+ */
+bool net_settle(Net* net, double timeout);
+
+#endif /* NET_H */
@@ -0,0 +1,224 @@
+/**
+ * Debris: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "particles.h"
+#include "mem.h"
+#include "shader.h"
+
+extern Pipeline* body_program;
+
+// fraction of its speed into a surface a particle bounces back with
+#define PARTICLES_BOUNCE 0.3f
+
+// a particle being pushed out of static bodies
+typedef struct ParticleHit {
+  float* point;
+  float* last_point;
+} ParticleHit;
+
+Particles* particles_new(World* world, int capacity) {
+  Particles* particles = mem_calloc(MEM_PARTICLES, 1, sizeof(Particles));
+  particles->world = world;
+  particles->capacity = capacity;
+  particles->points = mem_alloc(MEM_PARTICLES, sizeof(vec2) * capacity);
+  particles->last_points = mem_alloc(MEM_PARTICLES, sizeof(vec2) * capacity);
+  particles->colors = mem_alloc(MEM_PARTICLES, sizeof(vec3) * capacity);
+  particles->life = mem_alloc(MEM_PARTICLES, sizeof(int) * capacity);
+  particles->vertices = mem_alloc(MEM_PARTICLES,
+    (sizeof(vec2) + sizeof(vec3)) * capacity);
+  particles->seed = 1;
+  return particles;
+}
+
+void particles_free(Particles* particles) {
+  if (particles->vbo != 0) {
+    glDeleteBuffers(1, &particles->vbo);
+    mem_track(MEM_GPU, -(long) ((sizeof(vec2) + sizeof(vec3))
+      * particles->capacity));
+  }
+  mem_free(particles->points);
+  mem_free(particles->last_points);
+  mem_free(particles->colors);
+  mem_free(particles->life);
+  mem_free(particles->vertices);
+  mem_free(particles);
+}
+
+static float random_unit(Particles* particles) {
+  return rand_r(&particles->seed) / (float) RAND_MAX;
+}
+
+void particles_burst(Particles* particles, vec4 bbox, vec2 velocity,
+  float spread, vec3 color, int count)
+{
+  int k;
+  for (k = 0; k < count; k++) {
+    int i = particles->next++ % particles->capacity;
+    float x = bbox[0] + (bbox[2] - bbox[0]) * random_unit(particles);
+    float y = bbox[1] + (bbox[3] - bbox[1]) * random_unit(particles);
+    float vx = velocity[0] + spread * (2.0f * random_unit(particles) - 1.0f);
+    float vy = velocity[1] + spread * (2.0f * random_unit(particles) - 1.0f);
+
+    // out of room, the oldest go
+    if (particles->next - particles->first > (unsigned) particles->capacity)
+      particles->first = particles->next - particles->capacity;
+    particles->points[i][0] = x;
+    particles->points[i][1] = y;
+    particles->last_points[i][0] = x - vx;
+    particles->last_points[i][1] = y - vy;
+    memcpy(particles->colors[i], color, sizeof(vec3));
+    particles->life[i] = PARTICLES_LIFE;
+  }
+}
+
+// take some of the speed into a surface back out of it, along its
+// normal, keeping the speed along it
+static void bounce(float* point, float* last_point, float nx, float ny) {
+  float vx = point[0] - last_point[0];
+  float vy = point[1] - last_point[1];
+  float vn = vx * nx + vy * ny;
+  if (vn < 0.0f) {
+    vx -= (1.0f + PARTICLES_BOUNCE) * vn * nx;
+    vy -= (1.0f + PARTICLES_BOUNCE) * vn * ny;
+    last_point[0] = point[0] - vx;
+    last_point[1] = point[1] - vy;
+  }
+}
+
+// push a particle out of a static body by the shortest way, found by
+// separating axes over the body's edges
+static bool push_out(Body* body, void* vhit) {
+  ParticleHit* hit = vhit;
+  float* point = hit->point;
+  float depth = 1e30f, nx = 0.0f, ny = 0.0f;
+  vec2 axis, range;
+  int i;
+
+  // the static tree may be a step behind, bodies can leave it
+  if (body->type != BODY_STATIC || point[0] < body->bbox[0]
+    || point[0] > body->bbox[2] || point[1] < body->bbox[1]
+    || point[1] > body->bbox[3])
+    return false;
+
+  for (i = 0; i < body->num_edges; i++) {
+    Edge* edge = &body->edges[i];
+    float dx = (*edge->point2)[0] - (*edge->point1)[0];
+    float dy = (*edge->point2)[1] - (*edge->point1)[1];
+    float len = dx*dx + dy*dy, dot;
+    if (len == 0.0f)
+      continue;
+    len = 1.0f / sqrtf(len);
+    axis[0] = -dy * len;
+    axis[1] = dx * len;
+    body_project(body, axis, range);
+    dot = axis[0] * point[0] + axis[1] * point[1];
+    if (dot <= range[0] || dot >= range[1])
+      return false;
+    if (range[1] - dot < depth) {
+      depth = range[1] - dot;
+      nx = axis[0];
+      ny = axis[1];
+    }
+    if (dot - range[0] < depth) {
+      depth = dot - range[0];
+      nx = -axis[0];
+      ny = -axis[1];
+    }
+  }
+  if (nx == 0.0f && ny == 0.0f)
+    return false;
+
+  point[0] += nx * depth;
+  point[1] += ny * depth;
+  bounce(point, hit->last_point, nx, ny);
+  return false;
+}
+
+void particles_step(Particles* particles) {
+  World* world = particles->world;
+  float* bounds = world->bounds;
+  ParticleHit hit;
+  vec4 bbox;
+  unsigned p;
+
+  for (p = particles->first; p != particles->next; p++) {
+    int i = p % particles->capacity;
+    float* point = particles->points[i];
+    float* last_point = particles->last_points[i];
+    float nx = point[0] + point[0] - last_point[0];
+    float ny = point[1] + point[1] - last_point[1] - world->gravity;
+
+    last_point[0] = point[0];
+    last_point[1] = point[1];
+    point[0] = clamp(nx, bounds[0], bounds[2]);
+    point[1] = clamp(ny, bounds[1], bounds[3]);
+    if (point[0] != nx)
+      bounce(point, last_point, (nx < bounds[0])? 1.0f : -1.0f, 0.0f);
+    if (point[1] != ny)
+      bounce(point, last_point, 0.0f, (ny < bounds[1])? 1.0f : -1.0f);
+
+    hit.point = point;
+    hit.last_point = last_point;
+    bbox[0] = bbox[2] = point[0];
+    bbox[1] = bbox[3] = point[1];
+    bvh_query(world->static_tree, bbox, push_out, &hit);
+    particles->life[i]--;
+  }
+
+  // they all live as long, so the oldest are the first to go
+  while (particles->first != particles->next
+    && particles->life[particles->first % particles->capacity] <= 0)
+    particles->first++;
+}
+
+void particles_render(Particles* particles) {
+  int count = particles_count(particles), k = 0;
+  float* coords = particles->vertices;
+  float* colors = particles->vertices + 2 * particles->capacity;
+  unsigned p;
+
+  if (count == 0)
+    return;
+
+  // live particles may wrap around the ring, they are packed in order
+  // and faded as they go
+  for (p = particles->first; p != particles->next; p++, k++) {
+    int i = p % particles->capacity;
+    float fade = particles->life[i] / (float) PARTICLES_LIFE;
+    coords[k * 2 + 0] = particles->points[i][0];
+    coords[k * 2 + 1] = particles->points[i][1];
+    colors[k * 3 + 0] = particles->colors[i][0] * fade;
+    colors[k * 3 + 1] = particles->colors[i][1] * fade;
+    colors[k * 3 + 2] = particles->colors[i][2] * fade;
+  }
+
+  if (particles->vbo == 0) {
+    glGenBuffers(1, &particles->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, particles->vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+      (sizeof(vec2) + sizeof(vec3)) * particles->capacity, NULL,
+      GL_STREAM_DRAW);
+    mem_track(MEM_GPU, (sizeof(vec2) + sizeof(vec3)) * particles->capacity);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, particles->vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec2) * count, coords);
+  glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec2) * particles->capacity,
+    sizeof(vec3) * count, colors);
+  glVertexAttribPointer(pipeline_attribute(body_program, "coord"), 2, GL_FLOAT,
+    false, 0, (void*)(0));
+  glVertexAttribPointer(pipeline_attribute(body_program, "color"), 3, GL_FLOAT,
+    false, 0, (void*)(sizeof(vec2) * particles->capacity));
+  glPointSize(PARTICLES_SIZE);
+  glDrawArrays(GL_POINTS, 0, count);
+}
+
+int particles_count(Particles* particles) {
+  return particles->next - particles->first;
+}
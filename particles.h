@@ -0,0 +1,96 @@
+/**
+ * Debris: lots of single points that fall, bounce off static bodies
+ * and the world's bounds, and fade out. They never touch each other or
+ * anything that moves, and nothing they do reaches the simulation, so
+ * they cost a verlet step and a static tree lookup each.
+ * @author Scott LaVigne
+ */
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "world.h"
+
+/**
+ * Ticks a particle lives. Every particle lives as long, so they die in
+ * the order they were made.
+ */
+#define PARTICLES_LIFE 90
+
+/**
+ * Size particles are drawn at, in pixels
+ */
+#define PARTICLES_SIZE 3.0
+
+/**
+ * A ring of particles, allocated once. A burst with no room left
+ * takes over the oldest particles.
+ */
+typedef struct Particles {
+
+  World* world; // collided with and pulled down by
+  int capacity;
+  unsigned first; // oldest live particle, counting every one made
+  unsigned next;  // the next particle made; live ones are first..next-1,
+                  // at index % capacity
+
+  vec2* points;
+  vec2* last_points;
+  vec3* colors;
+  int* life;      // ticks left
+
+  unsigned seed;      // for rand_r
+  float* vertices;    // scratch for drawing, points then faded colors
+  unsigned vbo;
+
+} Particles;
+
+/**
+ * Create a particle pool for a world.
+ * @param  world    a world
+ * @param  capacity most particles alive at once
+ * @return          a new pool
+ */
+Particles* particles_new(World* world, int capacity);
+
+/**
+ * Free a particle pool and its buffer.
+ * @param particles a pool
+ */
+void particles_free(Particles* particles);
+
+/**
+ * Make particles scattered over a region, flying off with a velocity
+ * and a random spread.
+ * @param particles a pool
+ * @param bbox      the region = {minX minY maxX maxY}
+ * @param velocity  per tick
+ * @param spread    most random speed added per tick
+ * @param color     color of every particle
+ * @param count     how many
+ */
+void particles_burst(Particles* particles, vec4 bbox, vec2 velocity,
+  float spread, vec3 color, int count);
+
+/**
+ * Step every live particle once, with the world's gravity, and push
+ * any that end up inside a static body or outside the bounds back
+ * out. Call after the world steps.
+ * @param particles a pool
+ */
+void particles_step(Particles* particles);
+
+/**
+ * Draw every live particle as a point, in one draw call. The body
+ * pipeline must be in use.
+ * @param particles a pool
+ */
+void particles_render(Particles* particles);
+
+/**
+ * Get how many particles are alive.
+ * @param  particles a pool
+ * @return           the count
+ */
+int particles_count(Particles* particles);
+
+#endif /* PARTICLES_H */
@@ -0,0 +1,269 @@
+/**
+ * Point, region, ray and shape queries over the bodies in the world:
+ * implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "query.h"
+#include "world.h"
+#include "mem.h"
+
+// candidates are the bodies the broadphase turned up
+static bool gather(Body* body, void* vworld) {
+  World* world = vworld;
+  if (world->num_query_candidates == world->query_candidate_capacity) {
+    world->query_candidate_capacity = (world->query_candidate_capacity > 0)?
+      world->query_candidate_capacity * 2 : 32;
+    world->query_candidates = mem_realloc(MEM_WORLDS, world->query_candidates,
+      sizeof(Body*) * world->query_candidate_capacity);
+  }
+  world->query_candidates[world->num_query_candidates++] = body;
+  return false;
+}
+
+// bbox the shape covers over the whole query
+static void query_bounds(Query* query, vec4 bbox) {
+  int i, end;
+  bbox[0] = bbox[2] = query->from[0];
+  bbox[1] = bbox[3] = query->from[1];
+  for (end = 0; end < 2; end++) {
+    float* origin = end? query->to : query->from;
+    bbox[0] = min(bbox[0], origin[0]);
+    bbox[1] = min(bbox[1], origin[1]);
+    bbox[2] = max(bbox[2], origin[0]);
+    bbox[3] = max(bbox[3], origin[1]);
+    for (i = 0; i < query->num_shape; i++) {
+      bbox[0] = min(bbox[0], origin[0] + query->shape[i][0]);
+      bbox[1] = min(bbox[1], origin[1] + query->shape[i][1]);
+      bbox[2] = max(bbox[2], origin[0] + query->shape[i][0]);
+      bbox[3] = max(bbox[3], origin[1] + query->shape[i][1]);
+    }
+  }
+}
+
+static void project(vec2* points, int num_points, vec2 offset, vec2 axis,
+  float* lo, float* hi)
+{
+  int i;
+  *lo = *hi = (offset[0] + points[0][0]) * axis[0]
+    + (offset[1] + points[0][1]) * axis[1];
+  for (i = 1; i < num_points; i++) {
+    float d = (offset[0] + points[i][0]) * axis[0]
+      + (offset[1] + points[i][1]) * axis[1];
+    *lo = min(*lo, d);
+    *hi = max(*hi, d);
+  }
+}
+
+typedef struct Sweep {
+  float enter;  // last time the shape starts overlapping on an axis
+  float exit;   // first time it stops
+  vec2 normal;
+} Sweep;
+
+// narrow the time the shape and body overlap to those on one axis.
+// Returns false once they can't overlap at all.
+static bool sweep_axis(Sweep* sweep, Query* query, Body* body,
+  vec2 p1, vec2 p2, vec2 dir)
+{
+  vec2 zero = {0.0, 0.0};
+  vec2 axis = {p1[1] - p2[1], p2[0] - p1[0]};
+  float length = sqrt(axis[0]*axis[0] + axis[1]*axis[1]);
+  float body_lo, body_hi, shape_lo, shape_hi, speed, t1, t2;
+
+  if (length < 1e-6)
+    return true;
+  axis[0] /= length;
+  axis[1] /= length;
+
+  project(body->points, body->num_points, zero, axis, &body_lo, &body_hi);
+  if (query->shape == NULL)
+    shape_lo = shape_hi = query->from[0] * axis[0] + query->from[1] * axis[1];
+  else
+    project(query->shape, query->num_shape, query->from, axis,
+      &shape_lo, &shape_hi);
+
+  speed = dir[0] * axis[0] + dir[1] * axis[1];
+  if (fabs(speed) < 1e-9)
+    return shape_hi >= body_lo && shape_lo <= body_hi;
+
+  t1 = (body_lo - shape_hi) / speed;
+  t2 = (body_hi - shape_lo) / speed;
+  if (t1 > t2) {
+    float t = t1;
+    t1 = t2;
+    t2 = t;
+  }
+  if (t1 > sweep->enter) {
+    // moving along the axis runs into the body's low side
+    sweep->enter = t1;
+    sweep->normal[0] = (speed > 0.0)? -axis[0] : axis[0];
+    sweep->normal[1] = (speed > 0.0)? -axis[1] : axis[1];
+  }
+  sweep->exit = min(sweep->exit, t2);
+  return sweep->enter <= sweep->exit;
+}
+
+static void test(World* world, Query* query, Body* body, vec4 bounds) {
+  Sweep sweep = {-INFINITY, INFINITY, {0.0, 0.0}};
+  vec2 dir = {query->to[0] - query->from[0], query->to[1] - query->from[1]};
+  float length = sqrt(dir[0]*dir[0] + dir[1]*dir[1]);
+  QueryHit* hit;
+  int i;
+
+  if ((body->mask & query->mask) == 0)
+    return;
+  if (body->bbox[0] > bounds[2] || body->bbox[1] > bounds[3]
+    || body->bbox[2] < bounds[0] || body->bbox[3] < bounds[1])
+    return;
+  body_sync_points(body);
+
+  // separating axes are the body's edges and the shape's sides
+  for (i = 0; i < body->num_edges; i++)
+    if (sweep_axis(&sweep, query, body, *body->edges[i].point1,
+      *body->edges[i].point2, dir) == false)
+      return;
+  for (i = 0; i < query->num_shape && query->num_shape > 1; i++)
+    if (sweep_axis(&sweep, query, body, query->shape[i],
+      query->shape[(i + 1) % query->num_shape], dir) == false)
+      return;
+  if (sweep.enter > 1.0 || sweep.exit < 0.0)
+    return;
+
+  if (world->num_query_found == world->query_found_capacity) {
+    world->query_found_capacity = (world->query_found_capacity > 0)?
+      world->query_found_capacity * 2 : 32;
+    world->query_found = mem_realloc(MEM_WORLDS, world->query_found,
+      sizeof(QueryHit) * world->query_found_capacity);
+  }
+  hit = &world->query_found[world->num_query_found++];
+  hit->body = body;
+
+  if (length < 1e-6) {
+    // in place, nearest is by center
+    vec2 center = {query->from[0], query->from[1]};
+    for (i = 0; i < query->num_shape; i++) {
+      center[0] += query->shape[i][0] / query->num_shape;
+      center[1] += query->shape[i][1] / query->num_shape;
+    }
+    hit->distance = sqrt(
+      (center[0] - body->center_of_mass[0]) * (center[0] - body->center_of_mass[0])
+      + (center[1] - body->center_of_mass[1]) * (center[1] - body->center_of_mass[1]));
+    hit->point[0] = query->from[0];
+    hit->point[1] = query->from[1];
+    hit->normal[0] = hit->normal[1] = 0.0;
+  } else {
+    // starting inside the body is a hit at the start
+    float t = max(sweep.enter, 0.0);
+    hit->distance = t * length;
+    hit->point[0] = query->from[0] + dir[0] * t;
+    hit->point[1] = query->from[1] + dir[1] * t;
+    hit->normal[0] = (sweep.enter > 0.0)? sweep.normal[0] : 0.0;
+    hit->normal[1] = (sweep.enter > 0.0)? sweep.normal[1] : 0.0;
+  }
+}
+
+static int compare_hits(const void* va, const void* vb) {
+  const QueryHit* a = va;
+  const QueryHit* b = vb;
+  if (a->distance != b->distance)
+    return (a->distance < b->distance)? -1 : 1;
+  return a->body->id - b->body->id;
+}
+
+// test every candidate against a query and keep the nearest hits
+static void run_candidates(World* world, Query* query) {
+  vec4 bounds;
+  int i;
+
+  query_bounds(query, bounds);
+  world->num_query_found = 0;
+  for (i = 0; i < world->num_query_candidates; i++)
+    test(world, query, world->query_candidates[i], bounds);
+
+  qsort(world->query_found, world->num_query_found, sizeof(QueryHit),
+    compare_hits);
+  query->num_hits = (world->num_query_found < query->max_hits)?
+    world->num_query_found : query->max_hits;
+  memcpy(query->hits, world->query_found, sizeof(QueryHit) * query->num_hits);
+}
+
+void query_run(World* world, Query* query) {
+  vec4 bounds;
+
+  world->num_query_candidates = 0;
+  if (query->shape == NULL
+    && (query->from[0] != query->to[0] || query->from[1] != query->to[1])) {
+    body_broadphase_ray(world, query->from, query->to, gather, world);
+  } else {
+    query_bounds(query, bounds);
+    body_broadphase_region(world, bounds, gather, world);
+  }
+  run_candidates(world, query);
+}
+
+void query_batch(World* world, Query* queries, int num_queries) {
+  vec4 bounds, all;
+  int i;
+
+  if (num_queries <= 0)
+    return;
+
+  query_bounds(&queries[0], all);
+  for (i = 1; i < num_queries; i++) {
+    query_bounds(&queries[i], bounds);
+    all[0] = min(all[0], bounds[0]);
+    all[1] = min(all[1], bounds[1]);
+    all[2] = max(all[2], bounds[2]);
+    all[3] = max(all[3], bounds[3]);
+  }
+
+  world->num_query_candidates = 0;
+  body_broadphase_region(world, all, gather, world);
+  for (i = 0; i < num_queries; i++)
+    run_candidates(world, &queries[i]);
+}
+
+static int run(World* world, vec2 from, vec2 to, vec2* shape, int num_shape,
+  int mask, QueryHit* hits, int max_hits)
+{
+  Query query;
+  memcpy(query.from, from, sizeof(vec2));
+  memcpy(query.to, to, sizeof(vec2));
+  query.shape = shape;
+  query.num_shape = num_shape;
+  query.mask = mask;
+  query.hits = hits;
+  query.max_hits = max_hits;
+  query_run(world, &query);
+  return query.num_hits;
+}
+
+int query_point(World* world, vec2 point, int mask,
+  QueryHit* hits, int max_hits)
+{
+  return run(world, point, point, NULL, 0, mask, hits, max_hits);
+}
+
+int query_region(World* world, vec4 bbox, int mask,
+  QueryHit* hits, int max_hits)
+{
+  float w = bbox[2] - bbox[0], h = bbox[3] - bbox[1];
+  vec2 box[4] = {{0.0, 0.0}, {w, 0.0}, {w, h}, {0.0, h}};
+  return run(world, bbox, bbox, box, 4, mask, hits, max_hits);
+}
+
+int query_ray(World* world, vec2 from, vec2 to, int mask,
+  QueryHit* hits, int max_hits)
+{
+  return run(world, from, to, NULL, 0, mask, hits, max_hits);
+}
+
+int query_shape(World* world, vec2* shape, int num_shape, vec2 from, vec2 to,
+  int mask, QueryHit* hits, int max_hits)
+{
+  return run(world, from, to, shape, num_shape, mask, hits, max_hits);
+}
@@ -0,0 +1,110 @@
+/**
+ * Point, region, ray and shape queries over the bodies in the world
+ * @author Scott LaVigne
+ */
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdbool.h>
+
+#include "body.h"
+
+typedef struct QueryHit {
+
+  Body* body;
+  float distance; // along the cast, or between centers for queries in place
+  vec2 point;     // where the query shape is when it touches the body
+  vec2 normal;    // surface normal of the body there, zero in place
+
+} QueryHit;
+
+/**
+ * A convex shape moved in a straight line. Every query is one: a point
+ * is a shape without points, a region a box, and a query in place has
+ * from equal to to.
+ */
+typedef struct Query {
+
+  vec2 from;      // where the shape starts
+  vec2 to;        // where it stops
+  vec2* shape;    // outline in order, relative to from. NULL for a point
+  int num_shape;
+  int mask;       // only bodies in these collision groups are hit
+
+  QueryHit* hits; // filled in nearest first
+  int max_hits;
+  int num_hits;   // hits stored
+
+} Query;
+
+/**
+ * Run a query. Bodies are treated as convex, the same as collisions.
+ * @param world a world
+ * @param query a query, its hits are filled in
+ */
+void query_run(World* world, Query* query);
+
+/**
+ * Run many queries with one pass over the broadphase. Candidates for
+ * every query are gathered at once and shared, so a batch should be
+ * close together, like the sensors of a single body.
+ * @param world       a world
+ * @param queries     queries, their hits are filled in
+ * @param num_queries number of queries
+ */
+void query_batch(World* world, Query* queries, int num_queries);
+
+/**
+ * Find the bodies under a point, nearest center first.
+ * @param  world    a world
+ * @param  point    the point
+ * @param  mask     collision groups to hit
+ * @param  hits     where to store hits
+ * @param  max_hits room in hits
+ * @return          the number of hits stored
+ */
+int query_point(World* world, vec2 point, int mask,
+  QueryHit* hits, int max_hits);
+
+/**
+ * Find the bodies overlapping a region, nearest center first.
+ * @param  world    a world
+ * @param  bbox     the region = {minX minY maxX maxY}
+ * @param  mask     collision groups to hit
+ * @param  hits     where to store hits
+ * @param  max_hits room in hits
+ * @return          the number of hits stored
+ */
+int query_region(World* world, vec4 bbox, int mask,
+  QueryHit* hits, int max_hits);
+
+/**
+ * Find the bodies a segment crosses, nearest first.
+ * @param  world    a world
+ * @param  from     start of the segment
+ * @param  to       end of the segment
+ * @param  mask     collision groups to hit
+ * @param  hits     where to store hits
+ * @param  max_hits room in hits
+ * @return          the number of hits stored
+ */
+int query_ray(World* world, vec2 from, vec2 to, int mask,
+  QueryHit* hits, int max_hits);
+
+/**
+ * Find the bodies a convex shape touches moving along a segment,
+ * nearest first.
+ * @param  world     a world
+ * @param  shape     outline in order, relative to from
+ * @param  num_shape number of points in the outline
+ * @param  from      start of the segment
+ * @param  to        end of the segment
+ * @param  mask      collision groups to hit
+ * @param  hits      where to store hits
+ * @param  max_hits  room in hits
+ * @return           the number of hits stored
+ */
+int query_shape(World* world, vec2* shape, int num_shape, vec2 from, vec2 to,
+  int mask, QueryHit* hits, int max_hits);
+
+#endif /* QUERY_H */
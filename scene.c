@@ -0,0 +1,789 @@
+/**
+ * Data-driven scenes of body prototypes and their instances: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scene.h"
+#include "world.h"
+
+#define SCENE_GRAVITY 0x01
+#define SCENE_BOXED   0x02
+#define SCENE_WIRE    0x04
+#define SCENE_RIGID   0x08
+#define SCENE_STATIC  0x10
+#define SCENE_KINEMATIC 0x20
+
+/**
+ * Compiled scenes are a header followed by packed arrays of 4-byte values:
+ *   SceneProtoRecord    protos[num_protos]
+ *   SceneInstanceRecord instances[num_instances]
+ *   vec2                points[num_points]
+ *   vec3                colors[num_points]
+ *   vec2i               edges[num_edges]
+ *   SceneJointRecord    joints[num_joints]
+ */
+typedef struct SceneHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t num_protos;
+  uint32_t num_instances;
+  uint32_t num_points;
+  uint32_t num_edges;
+  uint32_t num_joints;
+  float bounds[2];
+} SceneHeader;
+
+typedef struct SceneProtoRecord {
+  char name[SCENE_NAME_LENGTH];
+  uint32_t first_point;
+  uint32_t num_points;
+  uint32_t first_edge;
+  uint32_t num_edges;
+  float mass;
+  int32_t mask;
+  uint32_t flags;
+  float pressure;
+  float shape_match;
+} SceneProtoRecord;
+
+typedef struct SceneInstanceRecord {
+  char name[SCENE_NAME_LENGTH];
+  uint32_t proto;
+  float position[2];
+  float angle;
+  float scale;
+  int32_t mask;
+} SceneInstanceRecord;
+
+typedef struct SceneJointRecord {
+  uint32_t type;
+  int32_t instance1;
+  int32_t point1;
+  int32_t instance2;
+  int32_t point2;
+  float anchor[2];
+  float stiffness;
+  float damping;
+} SceneJointRecord;
+
+static const char* joint_types[] = {
+  [JOINT_DISTANCE] = "distance",
+  [JOINT_ROPE] = "rope",
+  [JOINT_SPRING] = "spring",
+  [JOINT_PIN] = "pin"
+};
+
+// state of the streaming text parser
+typedef struct SceneParser {
+  Scene* scene;
+  const char* path;
+  int line;
+  Prototype* proto; // prototype being defined, if any
+  int point_capacity;
+  int edge_capacity;
+  int proto_capacity;
+  int instance_capacity;
+  int joint_capacity;
+} SceneParser;
+
+// make room for one more element in a growable array
+static void* grow(void* array, int* capacity, int count, size_t size) {
+  if (count < *capacity)
+    return array;
+  *capacity = (*capacity == 0)? 8 : *capacity * 2;
+  return realloc(array, size * *capacity);
+}
+
+static void transform(Prototype* proto, Instance* instance, vec2* out) {
+  float rad = instance->angle * M_PI / 180.0;
+  float c = cos(rad) * instance->scale;
+  float s = sin(rad) * instance->scale;
+  int i;
+  for (i = 0; i < proto->num_points; i++) {
+    float x = proto->points[i][0];
+    float y = proto->points[i][1];
+    out[i][0] = instance->position[0] + x * c - y * s;
+    out[i][1] = instance->position[1] + x * s + y * c;
+  }
+}
+
+static void apply_flags(Prototype* proto, Instance* instance, Body* body) {
+  body->mask = instance->mask;
+  body->gravity = proto->gravity;
+  body->boxed = proto->boxed;
+  body->wire = proto->wire;
+  if (proto->pressure > 0.0)
+    body_set_pressure(body, proto->pressure);
+  if (proto->shape_match > 0.0)
+    body_set_shape_match(body, proto->shape_match);
+  body_set_rigid(body, proto->rigid);
+  body_set_type(body, proto->type);
+}
+
+static void spawn_instance(World* world, Scene* scene, Instance* instance) {
+  Prototype* proto = &scene->protos[instance->proto];
+  vec2* points = malloc(sizeof(vec2) * proto->num_points);
+
+  // rest lengths and mass come from the transformed pose
+  transform(proto, instance, points);
+  instance->body = body_new(points, proto->colors, proto->num_points,
+    proto->edges, proto->num_edges);
+  free(points);
+
+  instance->body->mass *= proto->mass;
+  apply_flags(proto, instance, instance->body);
+  world_add_body(world, instance->body);
+}
+
+static void spawn_joint(World* world, Scene* scene, SceneJoint* joint) {
+  Body* body1 = scene->instances[joint->instance1].body;
+  if (joint->type == JOINT_PIN)
+    joint_add_pin(world, body1, joint->point1, joint->anchor,
+      joint->stiffness);
+  else
+    joint_add(world, joint->type, body1, joint->point1,
+      scene->instances[joint->instance2].body, joint->point2,
+      joint->stiffness, joint->damping);
+}
+
+static void spawn_scene(World* world, Scene* scene) {
+  int i;
+  if (scene->bounds[0] > 0.0 && scene->bounds[1] > 0.0)
+    world_set_bounds(world, scene->bounds[0], scene->bounds[1]);
+  for (i = 0; i < scene->num_instances; i++)
+    spawn_instance(world, scene, &scene->instances[i]);
+  for (i = 0; i < scene->num_joints; i++)
+    spawn_joint(world, scene, &scene->joints[i]);
+}
+
+// whether a joint's instances exist and have its points
+static bool joint_valid(Scene* scene, SceneJoint* joint) {
+  Instance* instances = scene->instances;
+  if (joint->instance1 < 0 || joint->instance1 >= scene->num_instances
+    || joint->point1 < 0 || joint->point1
+      >= scene->protos[instances[joint->instance1].proto].num_points)
+    return false;
+  if (joint->type == JOINT_PIN)
+    return true;
+  return joint->instance2 >= 0 && joint->instance2 < scene->num_instances
+    && joint->instance2 != joint->instance1 && joint->point2 >= 0
+    && joint->point2
+      < scene->protos[instances[joint->instance2].proto].num_points;
+}
+
+static bool parse_error(SceneParser* parser, const char* message) {
+  printf("%s:%d: %s\n", parser->path, parser->line, message);
+  return false;
+}
+
+static bool parse_proto_line(SceneParser* parser, const char* key,
+  const char* args)
+{
+  Prototype* proto = parser->proto;
+  int value;
+
+  if (strcmp(key, "end") == 0) {
+    if (proto->num_points < 3)
+      return parse_error(parser, "prototype needs at least 3 points");
+    parser->proto = NULL;
+    return true;
+  }
+
+  if (strcmp(key, "point") == 0) {
+    int capacity = parser->point_capacity; // shared by points and colors
+    vec2 p;
+    vec3 c;
+    if (sscanf(args, "%f %f %f %f %f", &p[0], &p[1], &c[0], &c[1], &c[2]) != 5)
+      return parse_error(parser, "expected point <x> <y> <r> <g> <b>");
+    proto->points = grow(proto->points, &capacity, proto->num_points,
+      sizeof(vec2));
+    proto->colors = grow(proto->colors, &parser->point_capacity,
+      proto->num_points, sizeof(vec3));
+    memcpy(proto->points[proto->num_points], p, sizeof(vec2));
+    memcpy(proto->colors[proto->num_points], c, sizeof(vec3));
+    proto->num_points++;
+    return true;
+  }
+
+  if (strcmp(key, "edge") == 0) {
+    vec2i e;
+    if (sscanf(args, "%d %d", &e[0], &e[1]) != 2)
+      return parse_error(parser, "expected edge <point> <point>");
+    if (e[0] < 0 || e[0] >= proto->num_points
+      || e[1] < 0 || e[1] >= proto->num_points)
+      return parse_error(parser, "edge refers to an undefined point");
+    proto->edges = grow(proto->edges, &parser->edge_capacity,
+      proto->num_edges, sizeof(vec2i));
+    memcpy(proto->edges[proto->num_edges], e, sizeof(vec2i));
+    proto->num_edges++;
+    return true;
+  }
+
+  if (strcmp(key, "mass") == 0) {
+    if (sscanf(args, "%f", &proto->mass) != 1)
+      return parse_error(parser, "expected mass <scale>");
+    return true;
+  }
+
+  if (strcmp(key, "mask") == 0) {
+    proto->mask = strtol(args, NULL, 0);
+    return true;
+  }
+
+  if (strcmp(key, "pressure") == 0) {
+    if (sscanf(args, "%f", &proto->pressure) != 1)
+      return parse_error(parser, "expected pressure <stiffness>");
+    return true;
+  }
+
+  if (strcmp(key, "shape") == 0) {
+    if (sscanf(args, "%f", &proto->shape_match) != 1)
+      return parse_error(parser, "expected shape <stiffness>");
+    return true;
+  }
+
+  if (strcmp(key, "type") == 0) {
+    char type[16];
+    if (sscanf(args, "%15s", type) != 1)
+      return parse_error(parser, "expected type dynamic|kinematic|static");
+    if (strcmp(type, "dynamic") == 0)
+      proto->type = BODY_DYNAMIC;
+    else if (strcmp(type, "kinematic") == 0)
+      proto->type = BODY_KINEMATIC;
+    else if (strcmp(type, "static") == 0)
+      proto->type = BODY_STATIC;
+    else
+      return parse_error(parser, "expected type dynamic|kinematic|static");
+    return true;
+  }
+
+  if (strcmp(key, "gravity") == 0 || strcmp(key, "boxed") == 0
+    || strcmp(key, "wire") == 0 || strcmp(key, "rigid") == 0)
+  {
+    if (sscanf(args, "%d", &value) != 1)
+      return parse_error(parser, "expected a flag of 0 or 1");
+    if (key[0] == 'g')
+      proto->gravity = value;
+    else if (key[0] == 'b')
+      proto->boxed = value;
+    else if (key[0] == 'w')
+      proto->wire = value;
+    else
+      proto->rigid = value;
+    return true;
+  }
+
+  return parse_error(parser, "unknown prototype property");
+}
+
+static bool parse_body(SceneParser* parser, char* args) {
+  Scene* scene = parser->scene;
+  char proto_name[SCENE_NAME_LENGTH], name[SCENE_NAME_LENGTH];
+  Instance instance;
+  Prototype* proto;
+  char* option;
+  int used;
+
+  if (sscanf(args, "%31s %31s %f %f%n", proto_name, name,
+    &instance.position[0], &instance.position[1], &used) != 4)
+    return parse_error(parser, "expected body <proto> <name> <x> <y>");
+
+  proto = scene_prototype(scene, proto_name);
+  if (proto == NULL)
+    return parse_error(parser, "body uses an undefined prototype");
+
+  memcpy(instance.name, name, sizeof(name));
+  instance.proto = proto - scene->protos;
+  instance.angle = 0.0;
+  instance.scale = 1.0;
+  instance.mask = proto->mask;
+  instance.body = NULL;
+
+  // optional keyword/value pairs
+  for (option = strtok(args + used, " \t\r\n"); option != NULL;
+    option = strtok(NULL, " \t\r\n"))
+  {
+    char* value = strtok(NULL, " \t\r\n");
+    if (value == NULL)
+      return parse_error(parser, "body option is missing its value");
+    if (strcmp(option, "rotate") == 0)
+      instance.angle = strtof(value, NULL);
+    else if (strcmp(option, "scale") == 0)
+      instance.scale = strtof(value, NULL);
+    else if (strcmp(option, "mask") == 0)
+      instance.mask = strtol(value, NULL, 0);
+    else
+      return parse_error(parser, "unknown body option");
+  }
+
+  scene->instances = grow(scene->instances, &parser->instance_capacity,
+    scene->num_instances, sizeof(Instance));
+  scene->instances[scene->num_instances] = instance;
+  scene->num_instances++;
+  return true;
+}
+
+static bool parse_joint(SceneParser* parser, char* args) {
+  Scene* scene = parser->scene;
+  char type[16], name1[SCENE_NAME_LENGTH], name2[SCENE_NAME_LENGTH];
+  Instance* instance1;
+  Instance* instance2;
+  SceneJoint joint;
+  char* option;
+  int used;
+
+  memset(&joint, 0, sizeof(joint));
+  joint.stiffness = 1.0;
+  if (sscanf(args, "%15s%n", type, &used) != 1)
+    return parse_error(parser, "expected joint distance|rope|spring|pin");
+  for (joint.type = JOINT_DISTANCE; joint.type <= JOINT_PIN; joint.type++) {
+    if (strcmp(type, joint_types[joint.type]) == 0)
+      break;
+  }
+  if (joint.type > JOINT_PIN)
+    return parse_error(parser, "expected joint distance|rope|spring|pin");
+  args += used;
+
+  if (joint.type == JOINT_PIN) {
+    if (sscanf(args, "%31s %d %f %f%n", name1, &joint.point1,
+      &joint.anchor[0], &joint.anchor[1], &used) != 4)
+      return parse_error(parser, "expected joint pin <body> <point> <x> <y>");
+    instance2 = NULL;
+  } else {
+    if (sscanf(args, "%31s %d %31s %d%n", name1, &joint.point1, name2,
+      &joint.point2, &used) != 4)
+      return parse_error(parser,
+        "expected joint <type> <body> <point> <body> <point>");
+    instance2 = scene_instance(scene, name2);
+    if (instance2 == NULL)
+      return parse_error(parser, "joint uses an undefined body");
+    joint.instance2 = instance2 - scene->instances;
+  }
+  instance1 = scene_instance(scene, name1);
+  if (instance1 == NULL)
+    return parse_error(parser, "joint uses an undefined body");
+  joint.instance1 = instance1 - scene->instances;
+  if (joint.type == JOINT_PIN)
+    joint.instance2 = -1;
+  if (joint_valid(scene, &joint) == false)
+    return parse_error(parser, "joint refers to an undefined point");
+
+  // optional keyword/value pairs
+  for (option = strtok(args + used, " \t\r\n"); option != NULL;
+    option = strtok(NULL, " \t\r\n"))
+  {
+    char* value = strtok(NULL, " \t\r\n");
+    if (value == NULL)
+      return parse_error(parser, "joint option is missing its value");
+    if (strcmp(option, "stiffness") == 0)
+      joint.stiffness = strtof(value, NULL);
+    else if (strcmp(option, "damping") == 0 && joint.type == JOINT_SPRING)
+      joint.damping = strtof(value, NULL);
+    else
+      return parse_error(parser, "unknown joint option");
+  }
+
+  scene->joints = grow(scene->joints, &parser->joint_capacity,
+    scene->num_joints, sizeof(SceneJoint));
+  scene->joints[scene->num_joints] = joint;
+  scene->num_joints++;
+  return true;
+}
+
+static bool parse_line(SceneParser* parser, char* line) {
+  Scene* scene = parser->scene;
+  char key[16];
+  int used;
+
+  char* comment = strchr(line, '#');
+  if (comment != NULL)
+    *comment = '\0';
+
+  if (sscanf(line, "%15s%n", key, &used) != 1)
+    return true; // blank line
+
+  if (parser->proto != NULL)
+    return parse_proto_line(parser, key, line + used);
+
+  if (strcmp(key, "proto") == 0) {
+    char name[SCENE_NAME_LENGTH];
+    if (sscanf(line + used, "%31s", name) != 1)
+      return parse_error(parser, "expected proto <name>");
+    if (scene_prototype(scene, name) != NULL)
+      return parse_error(parser, "prototype is already defined");
+    scene->protos = grow(scene->protos, &parser->proto_capacity,
+      scene->num_protos, sizeof(Prototype));
+    parser->proto = &scene->protos[scene->num_protos++];
+    memset(parser->proto, 0, sizeof(Prototype));
+    memcpy(parser->proto->name, name, sizeof(name));
+    parser->proto->mass = 1.0;
+    parser->proto->mask = 0x01;
+    parser->proto->gravity = true;
+    parser->proto->boxed = true;
+    parser->point_capacity = 0;
+    parser->edge_capacity = 0;
+    return true;
+  }
+
+  if (strcmp(key, "body") == 0)
+    return parse_body(parser, line + used);
+
+  if (strcmp(key, "joint") == 0)
+    return parse_joint(parser, line + used);
+
+  if (strcmp(key, "bounds") == 0) {
+    if (sscanf(line + used, "%f %f", &scene->bounds[0], &scene->bounds[1]) != 2)
+      return parse_error(parser, "expected bounds <width> <height>");
+    return true;
+  }
+
+  return parse_error(parser, "unknown statement");
+}
+
+static Scene* parse_text(FILE* file, const char* path) {
+  SceneParser parser = {0};
+  char line[1024];
+  bool ok = true;
+
+  parser.scene = calloc(1, sizeof(Scene));
+  parser.path = path;
+
+  while (ok && fgets(line, sizeof(line), file) != NULL) {
+    parser.line++;
+    ok = parse_line(&parser, line);
+  }
+
+  if (ok && parser.proto != NULL)
+    ok = parse_error(&parser, "prototype is missing its end");
+
+  if (ok == false) {
+    scene_free(parser.scene);
+    return NULL;
+  }
+  return parser.scene;
+}
+
+static size_t compiled_size(SceneHeader* header) {
+  return sizeof(SceneHeader)
+    + sizeof(SceneProtoRecord) * header->num_protos
+    + sizeof(SceneInstanceRecord) * header->num_instances
+    + (sizeof(vec2) + sizeof(vec3)) * header->num_points
+    + sizeof(vec2i) * header->num_edges
+    + sizeof(SceneJointRecord) * header->num_joints;
+}
+
+static Scene* parse_compiled(const char* path) {
+  struct stat st;
+  SceneHeader* header;
+  uint32_t i;
+  int j;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    printf("Could not open scene %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+
+  void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("Could not map scene %s\n", path);
+    return NULL;
+  }
+
+  header = base;
+  if ((size_t) st.st_size < sizeof(SceneHeader)
+    || header->version != SCENE_VERSION
+    || header->size != (uint32_t) st.st_size
+    || compiled_size(header) != header->size)
+  {
+    printf("Scene %s is invalid\n", path);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  SceneProtoRecord* protos = (SceneProtoRecord*) (header + 1);
+  SceneInstanceRecord* instances =
+    (SceneInstanceRecord*) (protos + header->num_protos);
+  vec2* points = (vec2*) (instances + header->num_instances);
+  vec3* colors = (vec3*) (points + header->num_points);
+  vec2i* edges = (vec2i*) (colors + header->num_points);
+  SceneJointRecord* joints = (SceneJointRecord*) (edges + header->num_edges);
+
+  Scene* scene = calloc(1, sizeof(Scene));
+  scene->mapping = base;
+  scene->mapping_size = st.st_size;
+  scene->bounds[0] = header->bounds[0];
+  scene->bounds[1] = header->bounds[1];
+  scene->protos = malloc(sizeof(Prototype) * header->num_protos);
+  scene->instances = malloc(sizeof(Instance) * header->num_instances);
+  scene->joints = malloc(sizeof(SceneJoint) * header->num_joints);
+
+  // prototypes use the mapped arrays in place
+  for (i = 0; i < header->num_protos; i++) {
+    SceneProtoRecord* record = &protos[i];
+    Prototype* proto = &scene->protos[i];
+    // first + count could wrap, so compare count with what is left
+    if (record->num_points < 3
+      || record->first_point > header->num_points
+      || record->num_points > header->num_points - record->first_point
+      || record->first_edge > header->num_edges
+      || record->num_edges > header->num_edges - record->first_edge)
+    {
+      printf("Scene %s is corrupt\n", path);
+      scene_free(scene);
+      return NULL;
+    }
+    for (j = 0; j < (int) record->num_edges; j++) {
+      vec2i* edge = &edges[record->first_edge + j];
+      if ((uint32_t) (*edge)[0] >= record->num_points
+        || (uint32_t) (*edge)[1] >= record->num_points)
+      {
+        printf("Scene %s is corrupt\n", path);
+        scene_free(scene);
+        return NULL;
+      }
+    }
+    memcpy(proto->name, record->name, SCENE_NAME_LENGTH);
+    proto->name[SCENE_NAME_LENGTH - 1] = '\0';
+    proto->points = &points[record->first_point];
+    proto->colors = &colors[record->first_point];
+    proto->num_points = record->num_points;
+    proto->edges = &edges[record->first_edge];
+    proto->num_edges = record->num_edges;
+    proto->mass = record->mass;
+    proto->mask = record->mask;
+    proto->gravity = (record->flags & SCENE_GRAVITY) != 0;
+    proto->boxed = (record->flags & SCENE_BOXED) != 0;
+    proto->wire = (record->flags & SCENE_WIRE) != 0;
+    proto->rigid = (record->flags & SCENE_RIGID) != 0;
+    proto->type = (record->flags & SCENE_STATIC)? BODY_STATIC
+      : (record->flags & SCENE_KINEMATIC)? BODY_KINEMATIC : BODY_DYNAMIC;
+    proto->pressure = record->pressure;
+    proto->shape_match = record->shape_match;
+    scene->num_protos++;
+  }
+
+  for (i = 0; i < header->num_instances; i++) {
+    SceneInstanceRecord* record = &instances[i];
+    Instance* instance = &scene->instances[i];
+    if (record->proto >= header->num_protos) {
+      printf("Scene %s is corrupt\n", path);
+      scene_free(scene);
+      return NULL;
+    }
+    memcpy(instance->name, record->name, SCENE_NAME_LENGTH);
+    instance->name[SCENE_NAME_LENGTH - 1] = '\0';
+    instance->proto = record->proto;
+    instance->position[0] = record->position[0];
+    instance->position[1] = record->position[1];
+    instance->angle = record->angle;
+    instance->scale = record->scale;
+    instance->mask = record->mask;
+    instance->body = NULL;
+    scene->num_instances++;
+  }
+
+  for (i = 0; i < header->num_joints; i++) {
+    SceneJointRecord* record = &joints[i];
+    SceneJoint* joint = &scene->joints[i];
+    joint->type = record->type;
+    joint->instance1 = record->instance1;
+    joint->point1 = record->point1;
+    joint->instance2 = record->instance2;
+    joint->point2 = record->point2;
+    joint->anchor[0] = record->anchor[0];
+    joint->anchor[1] = record->anchor[1];
+    joint->stiffness = record->stiffness;
+    joint->damping = record->damping;
+    if (record->type > JOINT_PIN || joint_valid(scene, joint) == false) {
+      printf("Scene %s is corrupt\n", path);
+      scene_free(scene);
+      return NULL;
+    }
+    scene->num_joints++;
+  }
+  return scene;
+}
+
+static Scene* scene_open(const char* path, World* spawn) {
+  char magic[4];
+  Scene* scene;
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    printf("Could not open scene %s\n", path);
+    return NULL;
+  }
+
+  if (fread(magic, 4, 1, file) == 1 && memcmp(magic, SCENE_MAGIC, 4) == 0) {
+    fclose(file);
+    scene = parse_compiled(path);
+  } else {
+    rewind(file);
+    scene = parse_text(file, path);
+    fclose(file);
+  }
+
+  // only a scene that loaded whole is spawned, so a bad one leaves
+  // the world as it was
+  if (scene != NULL && spawn != NULL)
+    spawn_scene(spawn, scene);
+  return scene;
+}
+
+Scene* scene_load(World* world, const char* path) {
+  return scene_open(path, world);
+}
+
+Scene* scene_read(const char* path) {
+  return scene_open(path, NULL);
+}
+
+bool scene_compile(Scene* scene, const char* path) {
+  SceneHeader header;
+  int i, point = 0, edge = 0;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCENE_MAGIC, 4);
+  header.version = SCENE_VERSION;
+  header.num_protos = scene->num_protos;
+  header.num_instances = scene->num_instances;
+  header.num_joints = scene->num_joints;
+  header.bounds[0] = scene->bounds[0];
+  header.bounds[1] = scene->bounds[1];
+  for (i = 0; i < scene->num_protos; i++) {
+    header.num_points += scene->protos[i].num_points;
+    header.num_edges += scene->protos[i].num_edges;
+  }
+  header.size = compiled_size(&header);
+
+  // build the whole file in memory, then write it out once
+  char* base = calloc(1, header.size);
+  SceneProtoRecord* protos = (SceneProtoRecord*) (base + sizeof(SceneHeader));
+  SceneInstanceRecord* instances =
+    (SceneInstanceRecord*) (protos + header.num_protos);
+  vec2* points = (vec2*) (instances + header.num_instances);
+  vec3* colors = (vec3*) (points + header.num_points);
+  vec2i* edges = (vec2i*) (colors + header.num_points);
+  SceneJointRecord* joints = (SceneJointRecord*) (edges + header.num_edges);
+  memcpy(base, &header, sizeof(header));
+
+  for (i = 0; i < scene->num_protos; i++) {
+    Prototype* proto = &scene->protos[i];
+    SceneProtoRecord* record = &protos[i];
+    memcpy(record->name, proto->name, SCENE_NAME_LENGTH);
+    record->first_point = point;
+    record->num_points = proto->num_points;
+    record->first_edge = edge;
+    record->num_edges = proto->num_edges;
+    record->mass = proto->mass;
+    record->mask = proto->mask;
+    record->flags = (proto->gravity? SCENE_GRAVITY : 0)
+      | (proto->boxed? SCENE_BOXED : 0)
+      | (proto->wire? SCENE_WIRE : 0)
+      | (proto->rigid? SCENE_RIGID : 0)
+      | ((proto->type == BODY_STATIC)? SCENE_STATIC : 0)
+      | ((proto->type == BODY_KINEMATIC)? SCENE_KINEMATIC : 0);
+    record->pressure = proto->pressure;
+    record->shape_match = proto->shape_match;
+    memcpy(&points[point], proto->points, sizeof(vec2) * proto->num_points);
+    memcpy(&colors[point], proto->colors, sizeof(vec3) * proto->num_points);
+    memcpy(&edges[edge], proto->edges, sizeof(vec2i) * proto->num_edges);
+    point += proto->num_points;
+    edge += proto->num_edges;
+  }
+
+  for (i = 0; i < scene->num_instances; i++) {
+    Instance* instance = &scene->instances[i];
+    SceneInstanceRecord* record = &instances[i];
+    memcpy(record->name, instance->name, SCENE_NAME_LENGTH);
+    record->proto = instance->proto;
+    record->position[0] = instance->position[0];
+    record->position[1] = instance->position[1];
+    record->angle = instance->angle;
+    record->scale = instance->scale;
+    record->mask = instance->mask;
+  }
+
+  for (i = 0; i < scene->num_joints; i++) {
+    SceneJoint* joint = &scene->joints[i];
+    SceneJointRecord* record = &joints[i];
+    record->type = joint->type;
+    record->instance1 = joint->instance1;
+    record->point1 = joint->point1;
+    record->instance2 = joint->instance2;
+    record->point2 = joint->point2;
+    record->anchor[0] = joint->anchor[0];
+    record->anchor[1] = joint->anchor[1];
+    record->stiffness = joint->stiffness;
+    record->damping = joint->damping;
+  }
+
+  FILE* file = fopen(path, "wb");
+  bool ok = file != NULL && fwrite(base, header.size, 1, file) == 1;
+  if (file != NULL)
+    ok = (fclose(file) == 0) && ok;
+  if (ok == false)
+    printf("Could not write scene %s\n", path);
+  free(base);
+  return ok;
+}
+
+Prototype* scene_prototype(Scene* scene, const char* name) {
+  int i;
+  for (i = 0; i < scene->num_protos; i++) {
+    if (strcmp(scene->protos[i].name, name) == 0)
+      return &scene->protos[i];
+  }
+  return NULL;
+}
+
+Instance* scene_instance(Scene* scene, const char* name) {
+  int i;
+  for (i = 0; i < scene->num_instances; i++) {
+    if (strcmp(scene->instances[i].name, name) == 0)
+      return &scene->instances[i];
+  }
+  return NULL;
+}
+
+void scene_place(Scene* scene, Instance* instance) {
+  Prototype* proto = &scene->protos[instance->proto];
+  Body* body = instance->body;
+  body_set_type(body, BODY_DYNAMIC);
+  body_set_rigid(body, false);
+  transform(proto, instance, body->points);
+  memcpy(body->last_points, body->points, sizeof(vec2) * body->num_points);
+  apply_flags(proto, instance, body);
+  body_do_center(body->world, body);
+}
+
+void scene_free(Scene* scene) {
+  int i;
+  if (scene->mapping != NULL) {
+    munmap(scene->mapping, scene->mapping_size);
+  } else {
+    for (i = 0; i < scene->num_protos; i++) {
+      free(scene->protos[i].points);
+      free(scene->protos[i].colors);
+      free(scene->protos[i].edges);
+    }
+  }
+  free(scene->protos);
+  free(scene->instances);
+  free(scene->joints);
+  free(scene);
+}
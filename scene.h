@@ -0,0 +1,160 @@
+/**
+ * Data-driven scenes of body prototypes and their instances
+ * @author Scott LaVigne
+ */
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "body.h"
+#include "joint.h"
+
+#define SCENE_MAGIC "JPSC"
+#define SCENE_VERSION 4
+#define SCENE_NAME_LENGTH 32
+
+typedef struct Prototype {
+
+  char name[SCENE_NAME_LENGTH];
+
+  vec2* points;
+  vec3* colors;
+  int num_points;
+
+  vec2i* edges;
+  int num_edges;
+
+  float mass;   // multiplier on the mass the body computes for itself
+  int mask;
+  bool gravity;
+  bool boxed;
+  bool wire;
+  bool rigid;
+  BodyType type;
+  float pressure;    // see body_set_pressure, 0 for none
+  float shape_match; // see body_set_shape_match, 0 for none
+
+} Prototype;
+
+typedef struct Instance {
+
+  char name[SCENE_NAME_LENGTH];
+  int proto;    // index into the scene's prototypes
+  vec2 position;
+  float angle;  // in degrees
+  float scale;
+  int mask;
+  Body* body;   // NULL until the instance is spawned
+
+} Instance;
+
+typedef struct SceneJoint {
+
+  JointType type;
+  int instance1; // index into the scene's instances
+  int point1;
+  int instance2; // -1 for a pin
+  int point2;
+  vec2 anchor;   // where a pin holds its point
+  float stiffness;
+  float damping;
+
+} SceneJoint;
+
+typedef struct Scene {
+
+  Prototype* protos;
+  int num_protos;
+
+  Instance* instances;
+  int num_instances;
+
+  SceneJoint* joints;
+  int num_joints;
+
+  vec2 bounds;    // world size, zero if the scene doesn't set one
+
+  void* mapping;  // backing storage of a compiled scene
+  size_t mapping_size;
+
+} Scene;
+
+/**
+ * Load a scene, text or compiled, and spawn its bodies into a world.
+ *
+ * The text format is line based, '#' starts a comment:
+ *   proto <name>
+ *     point <x> <y> <r> <g> <b>
+ *     edge <point> <point>
+ *     mass <scale>
+ *     mask <bits>
+ *     gravity|boxed|wire|rigid <0 or 1>
+ *     type dynamic|kinematic|static
+ *     pressure <stiffness>
+ *     shape <stiffness>
+ *   end
+ *   body <proto> <name> <x> <y> [rotate <degrees>] [scale <s>] [mask <bits>]
+ *   joint distance|rope|spring <body> <point> <body> <point>
+ *     [stiffness <s>] [damping <d>]
+ *   joint pin <body> <point> <x> <y> [stiffness <s>]
+ *   bounds <width> <height>
+ *
+ * A joint comes after the bodies it joins. Bodies and joints are only
+ * created once the whole scene has loaded, so one that fails leaves
+ * the world as it was. Joint stiffness defaults to 1 and damping to 0,
+ * see joint.h.
+ * @param  world a world to spawn into
+ * @param  path  file path to the scene
+ * @return       a new scene, or NULL if it could not be loaded
+ */
+Scene* scene_load(World* world, const char* path);
+
+/**
+ * Read a scene, text or compiled, without spawning any bodies.
+ * @param  path file path to the scene
+ * @return      a new scene, or NULL if it could not be read
+ */
+Scene* scene_read(const char* path);
+
+/**
+ * Write a scene in its compiled binary form.
+ * @param  scene a scene
+ * @param  path  file path to write
+ * @return       true on success
+ */
+bool scene_compile(Scene* scene, const char* path);
+
+/**
+ * Find a prototype by name.
+ * @param  scene a scene
+ * @param  name  prototype name
+ * @return       the prototype, or NULL
+ */
+Prototype* scene_prototype(Scene* scene, const char* name);
+
+/**
+ * Find an instance by name.
+ * @param  scene a scene
+ * @param  name  instance name
+ * @return       the instance, or NULL
+ */
+Instance* scene_instance(Scene* scene, const char* name);
+
+/**
+ * Put a spawned instance back in its initial pose at rest, and
+ * restore the flags it was created with.
+ * @param scene    a scene
+ * @param instance an instance of the scene
+ */
+void scene_place(Scene* scene, Instance* instance);
+
+/**
+ * Free a scene. Bodies spawned from it still use its colors, so
+ * only free a scene that was read, or whose bodies are gone.
+ * @param scene a scene
+ */
+void scene_free(Scene* scene);
+
+#endif /* SCENE_H */
@@ -5,121 +5,652 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
 #include <GL/glew.h>
 
 #include "shader.h"
+#include "list.h"
+#include "mem.h"
+
+#define CACHE_MAGIC "JPPB"
+
+// header of a cached program binary, the binary follows it
+typedef struct CacheHeader {
+  char magic[4];
+  uint32_t format;
+  uint64_t key;
+} CacheHeader;
+
+static bool parallel = false; // driver compiles in the background
+static bool binaries = false; // driver can save and load programs
+static int notify = -1;       // inotify instance for watched sources
+static List* watched;         // pipelines to reload on change
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = data;
+  size_t i;
+  for (i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
 
-Shader* shader_new(ShaderType type, const char* path) {
+static uint64_t hash_string(uint64_t hash, const char* string) {
+  return hash_bytes(hash, string, (string != NULL)? strlen(string) : 0);
+}
 
-  Shader* shader = malloc(sizeof(Shader));
+// read a whole file into memory, size is set to its length
+static char* read_file(const char* path, size_t* size) {
+  struct stat st;
+  char* buffer;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
 
-  // Open the shader source
-  // load into gfx card
-  FILE* file = fopen(path, "rb");
-  fseek(file, 0, SEEK_END);
-  int size = ftell(file);
-  rewind(file);
-  char* buffer = malloc(size);
-  fread(buffer, size, 1, file);
+  buffer = mem_alloc(MEM_SHADERS, st.st_size + 1);
+  if (read(fd, buffer, st.st_size) != st.st_size) {
+    mem_free(buffer);
+    close(fd);
+    return NULL;
+  }
 
-  shader->id = glCreateShader(type);
-  shader->type = type;
-  glShaderSource(shader->id, 1, (const char**) &buffer, &size);
+  close(fd);
+  buffer[st.st_size] = '\0';
+  *size = st.st_size;
+  return buffer;
+}
+
+static void cache_path(Pipeline* pipeline, char* path, size_t size) {
+  snprintf(path, size, "%s/%016llx.bin", SHADER_CACHE_DIR,
+    (unsigned long long) pipeline->key);
+}
+
+static bool cache_load(Pipeline* pipeline) {
+  char path[256];
+  size_t size;
+  char* data;
+  CacheHeader* header;
+
+  if (binaries == false)
+    return false;
+
+  cache_path(pipeline, path, sizeof(path));
+  data = read_file(path, &size);
+  if (data == NULL)
+    return false;
+
+  header = (CacheHeader*) data;
+  if (size <= sizeof(CacheHeader)
+    || memcmp(header->magic, CACHE_MAGIC, 4) != 0
+    || header->key != pipeline->key)
+  {
+    mem_free(data);
+    return false;
+  }
+
+  glProgramBinary(pipeline->id, header->format, data + sizeof(CacheHeader),
+    size - sizeof(CacheHeader));
+  mem_free(data);
+  return true;
+}
 
-  free(buffer);
-  fclose(file);
+static void cache_save(Pipeline* pipeline) {
+  char path[256], temp[260];
+  int size = 0;
+  GLenum format;
+  CacheHeader header;
+
+  glGetProgramiv(pipeline->id, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return;
+
+  char* data = mem_alloc(MEM_SHADERS, size);
+  glGetProgramBinary(pipeline->id, size, &size, &format, data);
+
+  memcpy(header.magic, CACHE_MAGIC, 4);
+  header.format = format;
+  header.key = pipeline->key;
+
+  // write aside and rename, so a reader never sees half a binary
+  mkdir(SHADER_CACHE_DIR, 0755);
+  cache_path(pipeline, path, sizeof(path));
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  FILE* file = fopen(temp, "wb");
+  if (file != NULL) {
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(data, size, 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    if (ok == false || rename(temp, path) < 0)
+      unlink(temp);
+  }
+
+  mem_free(data);
+}
 
-  // Compile shader
-  printf("Compiling %s...", path);
+static void shader_compile(Shader* shader) {
+  if (shader->compiling == false) {
+    glCompileShader(shader->id);
+    shader->compiling = true;
+  }
+}
+
+static void shader_report(Shader* shader) {
   int compile_ok;
-  glCompileShader(shader->id);
   glGetShaderiv(shader->id, GL_COMPILE_STATUS, &compile_ok);
-
   if (compile_ok == false) {
-
-    printf("error!\n");
-    printf("Error in compilation of %s\n", path);
+    printf("Error in compilation of %s\n", shader->path);
 
     int info_size;
     glGetShaderiv(shader->id, GL_INFO_LOG_LENGTH, &info_size);
 
-    char* info = malloc(info_size);
+    char* info = mem_alloc(MEM_SHADERS, info_size);
     glGetShaderInfoLog(shader->id, info_size, NULL, info);
 
     printf("%s\n", info);
-    free(info);
-
-    exit(compile_ok);
+    mem_free(info);
   }
+}
 
-  printf("ok!\n");
+// start compiling and linking without waiting on either
+static void pipeline_issue(Pipeline* pipeline) {
+  shader_compile(pipeline->vert_shader);
+  shader_compile(pipeline->frag_shader);
 
-  return shader;
+  glAttachShader(pipeline->id, pipeline->vert_shader->id);
+  glAttachShader(pipeline->id, pipeline->frag_shader->id);
+
+  if (binaries)
+    glProgramParameteri(pipeline->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, true);
+  glLinkProgram(pipeline->id);
 }
 
-void shader_free(Shader* shader) {
+static uint32_t hash_name(const char* name) {
+  return (uint32_t) hash_string(14695981039346656037ULL, name);
+}
 
-  glDeleteShader(shader->id);
-  free(shader);
+static PipelineVariable* find_variable(PipelineVariable* variables,
+  int count, const char* name)
+{
+  uint32_t hash = hash_name(name);
+  int i;
+  for (i = 0; i < count; i++) {
+    if (variables[i].hash == hash && strcmp(variables[i].name, name) == 0)
+      return &variables[i];
+  }
+  return NULL;
 }
 
-Pipeline* pipeline_new(Shader* vert_shader, Shader* frag_shader) {
+static void reflect_free(Pipeline* pipeline) {
+  int i;
+  for (i = 0; i < pipeline->num_blocks; i++) {
+    glDeleteBuffers(1, &pipeline->blocks[i].buffer);
+    mem_track(MEM_GPU, -pipeline->blocks[i].size);
+    mem_free(pipeline->blocks[i].data);
+  }
+  mem_free(pipeline->attributes);
+  mem_free(pipeline->uniforms);
+  mem_free(pipeline->blocks);
+  pipeline->attributes = pipeline->uniforms = NULL;
+  pipeline->blocks = NULL;
+  pipeline->num_attributes = pipeline->num_uniforms = pipeline->num_blocks = 0;
+}
 
-  Pipeline* pipeline = malloc(sizeof(Pipeline));
+// arrays are reported as "name[0]", store them as "name"
+static void set_name(PipelineVariable* variable, const char* name) {
+  char* bracket;
+  snprintf(variable->name, sizeof(variable->name), "%s", name);
+  bracket = strchr(variable->name, '[');
+  if (bracket != NULL)
+    *bracket = '\0';
+  variable->hash = hash_name(variable->name);
+}
 
-  pipeline->id = glCreateProgram();
+// enumerate everything the linked program uses, once
+static void pipeline_reflect(Pipeline* pipeline) {
+  char name[32];
+  int count, i, size, index, offset;
+  GLenum type;
+
+  reflect_free(pipeline);
+
+  glGetProgramiv(pipeline->id, GL_ACTIVE_ATTRIBUTES, &count);
+  pipeline->attributes = mem_calloc(MEM_SHADERS, count,
+    sizeof(PipelineVariable));
+  for (i = 0; i < count; i++) {
+    PipelineVariable* attribute = &pipeline->attributes[pipeline->num_attributes];
+    glGetActiveAttrib(pipeline->id, i, sizeof(name), NULL, &size, &type, name);
+    attribute->location = glGetAttribLocation(pipeline->id, name);
+    if (attribute->location < 0)
+      continue; // built-ins such as gl_VertexID
+    set_name(attribute, name);
+    attribute->type = type;
+    attribute->size = size;
+    attribute->block = -1;
+    pipeline->num_attributes++;
+  }
 
-  pipeline->vert_shader = vert_shader;
-  pipeline->frag_shader = frag_shader;
+  glGetProgramiv(pipeline->id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  pipeline->blocks = mem_calloc(MEM_SHADERS, count, sizeof(PipelineBlock));
+  pipeline->num_blocks = count;
+  for (i = 0; i < count; i++) {
+    PipelineBlock* block = &pipeline->blocks[i];
+    glGetActiveUniformBlockName(pipeline->id, i, sizeof(block->name), NULL,
+      block->name);
+    glGetActiveUniformBlockiv(pipeline->id, i, GL_UNIFORM_BLOCK_DATA_SIZE,
+      &block->size);
+    glUniformBlockBinding(pipeline->id, i, i);
+    block->data = mem_calloc(MEM_SHADERS, 1, block->size);
+    glGenBuffers(1, &block->buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, block->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, block->size, NULL, GL_DYNAMIC_DRAW);
+    mem_track(MEM_GPU, block->size);
+    block->dirty = true;
+  }
 
-  // Attach the shaders
-  glAttachShader(pipeline->id, vert_shader->id);
-  glAttachShader(pipeline->id, frag_shader->id);
-  
-  printf("Linking program...");
-  int link_ok;
-  glLinkProgram(pipeline->id);
+  glGetProgramiv(pipeline->id, GL_ACTIVE_UNIFORMS, &count);
+  pipeline->uniforms = mem_calloc(MEM_SHADERS, count, sizeof(PipelineVariable));
+  pipeline->num_uniforms = count;
+  for (i = 0; i < count; i++) {
+    PipelineVariable* uniform = &pipeline->uniforms[i];
+    GLuint unsigned_i = i;
+    glGetActiveUniform(pipeline->id, i, sizeof(name), NULL, &size, &type, name);
+    glGetActiveUniformsiv(pipeline->id, 1, &unsigned_i,
+      GL_UNIFORM_BLOCK_INDEX, &index);
+    glGetActiveUniformsiv(pipeline->id, 1, &unsigned_i,
+      GL_UNIFORM_OFFSET, &offset);
+    set_name(uniform, name);
+    uniform->type = type;
+    uniform->size = size;
+    uniform->block = index;
+    uniform->offset = offset;
+    uniform->location = (index < 0)?
+      glGetUniformLocation(pipeline->id, name) : -1;
+  }
+}
 
+// write a value into its block, or straight to the bound program
+static void value_upload(Pipeline* pipeline, PipelineValue* value) {
+  PipelineVariable* uniform =
+    find_variable(pipeline->uniforms, pipeline->num_uniforms, value->name);
+  const float* f = (const float*) value->data;
+  const int* n = (const int*) value->data;
+
+  if (uniform == NULL)
+    return;
+
+  if (uniform->block >= 0) {
+    PipelineBlock* block = &pipeline->blocks[uniform->block];
+    int size = block->size - uniform->offset;
+    if (value->size < size)
+      size = value->size;
+    memcpy(block->data + uniform->offset, value->data, size);
+    block->dirty = true;
+    return;
+  }
+
+  switch (uniform->type) {
+    case GL_FLOAT:      glUniform1fv(uniform->location, value->size / 4, f); break;
+    case GL_FLOAT_VEC2: glUniform2fv(uniform->location, value->size / 8, f); break;
+    case GL_FLOAT_VEC3: glUniform3fv(uniform->location, value->size / 12, f); break;
+    case GL_FLOAT_VEC4: glUniform4fv(uniform->location, value->size / 16, f); break;
+    case GL_FLOAT_MAT4:
+      glUniformMatrix4fv(uniform->location, value->size / 64, false, f);
+      break;
+    default:            glUniform1iv(uniform->location, value->size / 4, n); break;
+  }
+}
+
+// wait for the link and check it
+static bool pipeline_finish(Pipeline* pipeline) {
+  int link_ok;
   glGetProgramiv(pipeline->id, GL_LINK_STATUS, &link_ok);
 
+  // a stale binary is rejected at load, build from source instead
+  if (link_ok == false && pipeline->cached) {
+    glDeleteProgram(pipeline->id);
+    pipeline->id = glCreateProgram();
+    pipeline->cached = false;
+    pipeline_issue(pipeline);
+    glGetProgramiv(pipeline->id, GL_LINK_STATUS, &link_ok);
+  }
+
   if (link_ok == false) {
-    printf("error!\n");
+    shader_report(pipeline->vert_shader);
+    shader_report(pipeline->frag_shader);
 
     printf("Error in linking\n");
 
     int info_size;
     glGetProgramiv(pipeline->id, GL_INFO_LOG_LENGTH, &info_size);
 
-    char* info = malloc(info_size);
+    char* info = mem_alloc(MEM_SHADERS, info_size);
     glGetProgramInfoLog(pipeline->id, info_size, NULL, info);
 
     printf("%s\n", info);
-    free(info);
+    mem_free(info);
+
+    pipeline->failed = true;
+    return false;
+  }
+
+  if (pipeline->cached == false && binaries)
+    cache_save(pipeline);
+
+  pipeline->linked = true;
+  pipeline->failed = false;
+  pipeline_reflect(pipeline);
+  return true;
+}
+
+// take over the program and shaders of a rebuilt pipeline
+static void pipeline_swap(Pipeline* pipeline, Pipeline* next) {
+  int i;
+
+  glDeleteProgram(pipeline->id);
+  shader_free(pipeline->vert_shader);
+  shader_free(pipeline->frag_shader);
+
+  pipeline->id = next->id;
+  pipeline->vert_shader = next->vert_shader;
+  pipeline->frag_shader = next->frag_shader;
+  pipeline->key = next->key;
+  pipeline->cached = next->cached;
+  pipeline->linked = true;
+  pipeline->failed = false;
+
+  // the new program has new locations and blocks, values carry over
+  reflect_free(pipeline);
+  pipeline->attributes = next->attributes;
+  pipeline->num_attributes = next->num_attributes;
+  pipeline->uniforms = next->uniforms;
+  pipeline->num_uniforms = next->num_uniforms;
+  pipeline->blocks = next->blocks;
+  pipeline->num_blocks = next->num_blocks;
+  for (i = 0; i < pipeline->num_values; i++)
+    pipeline->values[i].dirty = true;
+  mem_free(next->values);
+  mem_free(next);
+}
 
-    exit(link_ok);
+// start building a replacement from the sources on disk
+static void pipeline_reload(Pipeline* pipeline) {
+  Shader* vert_shader;
+  Shader* frag_shader;
+
+  if (pipeline->next != NULL) {
+    pipeline_free(pipeline->next);
+    pipeline->next = NULL;
+  }
+
+  // an editor may still be writing, a later event will retry
+  vert_shader = shader_new(SHADER_VERTEX, pipeline->vert_shader->path);
+  frag_shader = shader_new(SHADER_FRAGMENT, pipeline->frag_shader->path);
+  if (vert_shader == NULL || frag_shader == NULL) {
+    if (vert_shader != NULL)
+      shader_free(vert_shader);
+    if (frag_shader != NULL)
+      shader_free(frag_shader);
+    return;
+  }
+
+  pipeline->next = pipeline_new(vert_shader, frag_shader);
+}
+
+static bool shader_changed(Shader* shader, int watch,
+  struct inotify_event* event)
+{
+  const char* name = strrchr(shader->path, '/');
+  name = (name != NULL)? name + 1 : shader->path;
+  return event->wd == watch && event->len > 0
+    && strcmp(event->name, name) == 0;
+}
+
+static bool reload_changed(void* vpipeline, void* vevent) {
+  Pipeline* pipeline = vpipeline;
+  struct inotify_event* event = vevent;
+  if (shader_changed(pipeline->vert_shader, pipeline->watch[0], event)
+    || shader_changed(pipeline->frag_shader, pipeline->watch[1], event))
+    pipeline_reload(pipeline);
+  return false;
+}
+
+static bool swap_finished(void* vpipeline, void* data) {
+  Pipeline* pipeline = vpipeline;
+  Pipeline* next = pipeline->next;
+
+  // without parallel compiles, waiting here is no worse than anywhere
+  if (next == NULL || (pipeline_ready(next) == false && parallel))
+    return false;
+
+  pipeline->next = NULL;
+  if (pipeline_finish(next)) {
+    pipeline_swap(pipeline, next);
+    printf("Reloaded %s and %s\n", pipeline->vert_shader->path,
+      pipeline->frag_shader->path);
+  } else {
+    printf("Keeping the previous program\n");
+    pipeline_free(next);
+  }
+  return false;
+}
+
+void shader_init() {
+  int formats = 0;
+
+#ifdef GL_KHR_parallel_shader_compile
+  if (GLEW_KHR_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    parallel = true;
+  }
+#endif
+
+  if (GLEW_ARB_get_program_binary)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  binaries = formats > 0;
+}
+
+void shader_poll() {
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t size;
+  char* cursor;
+
+  if (notify < 0)
+    return;
+
+  while ((size = read(notify, buffer, sizeof(buffer))) > 0) {
+    for (cursor = buffer; cursor < buffer + size;
+      cursor += sizeof(struct inotify_event) + ((struct inotify_event*) cursor)->len)
+      list_traverse(watched, reload_changed, cursor);
   }
 
-  printf("ok!\n");
+  list_traverse(watched, swap_finished, NULL);
+}
+
+Shader* shader_new(ShaderType type, const char* path) {
+
+  Shader* shader = mem_alloc(MEM_SHADERS, sizeof(Shader));
+  size_t size;
+
+  // Open the shader source
+  // load into gfx card
+  char* buffer = read_file(path, &size);
+  if (buffer == NULL) {
+    printf("Could not read %s\n", path);
+    mem_free(shader);
+    return NULL;
+  }
+
+  shader->id = glCreateShader(type);
+  shader->type = type;
+  shader->path = mem_strdup(MEM_SHADERS, path);
+  shader->hash = hash_bytes(14695981039346656037ULL, buffer, size);
+  shader->compiling = false;
+
+  int length = size;
+  glShaderSource(shader->id, 1, (const char**) &buffer, &length);
+
+  mem_free(buffer);
+  return shader;
+}
+
+void shader_free(Shader* shader) {
+
+  glDeleteShader(shader->id);
+  mem_free(shader->path);
+  mem_free(shader);
+}
+
+Pipeline* pipeline_new(Shader* vert_shader, Shader* frag_shader) {
+
+  Pipeline* pipeline = mem_calloc(MEM_SHADERS, 1, sizeof(Pipeline));
+  uint64_t key = 14695981039346656037ULL;
+
+  pipeline->id = glCreateProgram();
+
+  pipeline->vert_shader = vert_shader;
+  pipeline->frag_shader = frag_shader;
+  pipeline->watch[0] = pipeline->watch[1] = -1;
+
+  // binaries are only good for the same sources on the same driver
+  key = hash_string(key, (const char*) glGetString(GL_VENDOR));
+  key = hash_string(key, (const char*) glGetString(GL_RENDERER));
+  key = hash_string(key, (const char*) glGetString(GL_VERSION));
+  key = hash_bytes(key, &vert_shader->hash, sizeof(uint64_t));
+  key = hash_bytes(key, &frag_shader->hash, sizeof(uint64_t));
+  pipeline->key = key;
+
+  if (cache_load(pipeline))
+    pipeline->cached = true;
+  else
+    pipeline_issue(pipeline);
 
   return pipeline;
 }
 
-void pipeline_attribute(Pipeline* pipeline, const char* attr, unsigned id) {
+bool pipeline_ready(Pipeline* pipeline) {
+  int done = false;
+  if (pipeline->linked || pipeline->cached)
+    return true;
+  if (parallel)
+    glGetProgramiv(pipeline->id, GL_COMPLETION_STATUS_KHR, &done);
+  return done;
+}
+
+bool pipeline_use(Pipeline* pipeline) {
+  int i;
+  if (pipeline->linked == false && pipeline->failed == false)
+    pipeline_finish(pipeline);
+  if (pipeline->failed)
+    return false;
+  glUseProgram(pipeline->id);
+
+  for (i = 0; i < pipeline->num_values; i++) {
+    if (pipeline->values[i].dirty) {
+      value_upload(pipeline, &pipeline->values[i]);
+      pipeline->values[i].dirty = false;
+    }
+  }
+
+  for (i = 0; i < pipeline->num_blocks; i++) {
+    PipelineBlock* block = &pipeline->blocks[i];
+    if (block->dirty) {
+      glBindBuffer(GL_UNIFORM_BUFFER, block->buffer);
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, block->size, block->data);
+      block->dirty = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, i, block->buffer);
+  }
+  return true;
+}
+
+void pipeline_watch(Pipeline* pipeline) {
+  char vert_path[4096], frag_path[4096];
+  uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+  if (notify < 0) {
+    notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify < 0) {
+      printf("Could not watch shader sources\n");
+      return;
+    }
+    watched = list_new();
+  }
 
-  pipeline->attribute[id] = glGetAttribLocation(pipeline->id, attr);
+  // editors often replace files, so watch the directories
+  snprintf(vert_path, sizeof(vert_path), "%s", pipeline->vert_shader->path);
+  snprintf(frag_path, sizeof(frag_path), "%s", pipeline->frag_shader->path);
+  pipeline->watch[0] = inotify_add_watch(notify, dirname(vert_path), mask);
+  pipeline->watch[1] = inotify_add_watch(notify, dirname(frag_path), mask);
+  list_push_back(watched, pipeline);
 }
 
-void pipeline_uniform(Pipeline* pipeline, const char* unif, unsigned id) {
+int pipeline_attribute(Pipeline* pipeline, const char* attr) {
+  PipelineVariable* attribute =
+    find_variable(pipeline->attributes, pipeline->num_attributes, attr);
+  return (attribute != NULL)? attribute->location : -1;
+}
+
+void pipeline_uniform(Pipeline* pipeline, const char* unif,
+  const void* data, size_t size)
+{
+  uint32_t hash = hash_name(unif);
+  PipelineValue* value = NULL;
+  int i;
+
+  for (i = 0; i < pipeline->num_values; i++) {
+    if (pipeline->values[i].hash == hash
+      && strcmp(pipeline->values[i].name, unif) == 0)
+    {
+      value = &pipeline->values[i];
+      break;
+    }
+  }
+
+  if (value == NULL) {
+    pipeline->values = mem_realloc(MEM_SHADERS, pipeline->values,
+      sizeof(PipelineValue) * (pipeline->num_values + 1));
+    value = &pipeline->values[pipeline->num_values++];
+    snprintf(value->name, sizeof(value->name), "%s", unif);
+    value->hash = hash;
+  }
 
-  pipeline->uniform[id] = glGetUniformLocation(pipeline->id, unif);
+  value->size = (size < sizeof(value->data))? size : sizeof(value->data);
+  memcpy(value->data, data, value->size);
+  value->dirty = true;
 }
 
 void pipeline_free(Pipeline* pipeline) {
 
+  if (pipeline->next != NULL)
+    pipeline_free(pipeline->next);
+  // the last watched pipeline takes the watcher with it
+  if (watched != NULL && list_remove(watched, pipeline)
+    && watched->length == 0)
+  {
+    list_free(watched);
+    watched = NULL;
+    close(notify);
+    notify = -1;
+  }
+  reflect_free(pipeline);
+  mem_free(pipeline->values);
+
   shader_free(pipeline->vert_shader);
   shader_free(pipeline->frag_shader);
 
   glDeleteProgram(pipeline->id);
-  free(pipeline);
-}
\ No newline at end of file
+  mem_free(pipeline);
+}
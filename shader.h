@@ -6,9 +6,16 @@
 #define SHADER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 #include <GL/gl.h>
 
+/**
+ * Directory linked program binaries are cached in
+ */
+#define SHADER_CACHE_DIR ".shader_cache"
+
 typedef enum ShaderType {
 
   SHADER_VERTEX = GL_VERTEX_SHADER,
@@ -20,24 +27,103 @@ typedef struct Shader {
 
   unsigned id;
   ShaderType type;
+  char* path;
+  uint64_t hash;  // hash of the source
+  bool compiling; // whether a compile has been issued
 
 } Shader;
 
+/**
+ * An active attribute or uniform, found when the program links
+ */
+typedef struct PipelineVariable {
+
+  char name[32];
+  uint32_t hash;   // hash of the name, checked before comparing
+  int location;    // -1 for uniforms inside a block
+  unsigned type;   // GL type, e.g. GL_FLOAT_VEC2
+  int size;        // array length
+  int block;       // index of the uniform block, -1 for none
+  int offset;      // byte offset inside the block
+
+} PipelineVariable;
+
+/**
+ * A uniform block, backed by a uniform buffer and a staging copy that
+ * collects every update made in a frame
+ */
+typedef struct PipelineBlock {
+
+  char name[32];
+  unsigned buffer;
+  int size;
+  unsigned char* data;
+  bool dirty;
+
+} PipelineBlock;
+
+/**
+ * A uniform value set by the program. Values outlive links, so they
+ * can be set before the program is ready and survive reloads.
+ */
+typedef struct PipelineValue {
+
+  char name[32];
+  uint32_t hash;
+  int size;
+  unsigned char data[64]; // large enough for a mat4
+  bool dirty;
+
+} PipelineValue;
+
 typedef struct Pipeline {
 
   unsigned id;
   Shader* vert_shader;
   Shader* frag_shader;
-  unsigned attribute[8];
-  unsigned uniform[8];
+
+  // reflection, filled in once the program has linked
+  PipelineVariable* attributes;
+  int num_attributes;
+  PipelineVariable* uniforms;
+  int num_uniforms;
+  PipelineBlock* blocks;
+  int num_blocks;
+
+  PipelineValue* values;
+  int num_values;
+
+  uint64_t key;  // program cache key
+  bool linked;   // whether the link status has been checked
+  bool cached;   // whether the program came from the cache
+  bool failed;   // whether compiling or linking failed
+
+  // hot reloading
+  int watch[2];          // inotify watches on the vert and frag directories
+  struct Pipeline* next; // replacement being built from changed sources
 
 } Pipeline;
 
 /**
- * Allocates and compiles a shader
+ * Set up asynchronous shader compilation if the driver supports it.
+ * Call once after the GL context is created.
+ */
+void shader_init();
+
+/**
+ * Rebuild watched pipelines whose sources changed. A rebuild runs in
+ * the background and replaces the program only once it has linked;
+ * on failure the error is printed and the old program is kept.
+ * Call once per frame.
+ */
+void shader_poll();
+
+/**
+ * Allocates a shader and loads its source. Compilation is left to
+ * the pipeline, so a shader never compiles if its pipeline is cached.
  * @param  type shader type. Either SHADER_VERTEX or SHADER_FRAGMENT
  * @param  path file path to shader file
- * @return      a new shader object
+ * @return      a new shader object, or NULL if the source can't be read
  */
 Shader* shader_new(ShaderType type, const char* path);
 
@@ -48,29 +134,59 @@ Shader* shader_new(ShaderType type, const char* path);
 void shader_free(Shader* shader);
 
 /**
- * Links shaders into a shader program and returns it
+ * Creates a shader program from two shaders. The program is loaded
+ * from the binary cache when possible, otherwise compiling and
+ * linking are issued and left running; nothing waits on them until
+ * the pipeline is first used.
  * @param  vert_shader a vertex shader
  * @param  frag_shader a fragment shader
  * @return             a new shader program
  */
 Pipeline* pipeline_new(Shader* vert_shader, Shader* frag_shader);
 
-// locate an attribute and add it to an attribute table with id
 /**
- * Locate an attribute and add it to the attribute table under an id
+ * Check, without blocking, whether a shader program has finished
+ * compiling and linking.
+ * @param  pipeline a shader program
+ * @return          true if the program can be used without waiting
+ */
+bool pipeline_ready(Pipeline* pipeline);
+
+/**
+ * Bind a shader program for drawing. The first use waits for the
+ * link, reflects attributes and uniforms and fills the cache. Uniforms
+ * set since the last use are uploaded, one buffer update per block.
+ * @param  pipeline a shader program
+ * @return          false if the program failed to build
+ */
+bool pipeline_use(Pipeline* pipeline);
+
+/**
+ * Watch the source files of a shader program and rebuild it when
+ * they change. See shader_poll.
  * @param pipeline a shader program
- * @param attr     the attribute name to search for
- * @param id       an index in the shader to use
  */
-void pipeline_attribute(Pipeline* pipeline, const char* attr, unsigned id);
+void pipeline_watch(Pipeline* pipeline);
+
+/**
+ * Look up the location of an active attribute
+ * @param  pipeline a shader program
+ * @param  attr     the attribute name to search for
+ * @return          its location, or -1 if the program has not linked
+ *                  or the attribute is not active
+ */
+int pipeline_attribute(Pipeline* pipeline, const char* attr);
 
 /**
- * Locate a uniform and add it the uniform table under and id
+ * Set a uniform, in a block or not. The value is kept and uploaded
+ * on the next pipeline_use, so it may be set at any time.
  * @param pipeline a shader program
- * @param unif     the uniform name to search for
- * @param id       an index in the shader to use
+ * @param unif     the uniform name
+ * @param data     the value, laid out as the uniform's GL type
+ * @param size     size of the value in bytes, at most 64
  */
-void pipeline_uniform(Pipeline* pipeline, const char* unif, unsigned id);
+void pipeline_uniform(Pipeline* pipeline, const char* unif,
+  const void* data, size_t size);
 
 /**
  * Free a shader program
@@ -78,4 +194,4 @@ void pipeline_uniform(Pipeline* pipeline, const char* unif, unsigned id);
  */
 void pipeline_free(Pipeline* pipeline);
 
-#endif /* SHADER_H */
\ No newline at end of file
+#endif /* SHADER_H */
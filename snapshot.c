@@ -0,0 +1,573 @@
+/**
+ * Flat binary snapshots of the physics world: implementation
+ * @author Scott LaVigne
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "world.h"
+#include "list.h"
+
+// pointers to each section of a mapped snapshot
+typedef struct SnapshotView {
+  SnapshotHeader* header;
+  SnapshotBody* bodies;
+  vec2* points;
+  vec2* last_points;
+  vec3* colors;
+  vec2i* edges;
+  float* lengths;
+} SnapshotView;
+
+// running totals and cursors while walking the body list
+typedef struct SnapshotCursor {
+  SnapshotView* view;
+  uint32_t body;
+  uint32_t point;
+  uint32_t edge;
+  bool ok;
+} SnapshotCursor;
+
+static size_t snapshot_size(uint32_t num_bodies, uint32_t num_points,
+  uint32_t num_edges)
+{
+  return sizeof(SnapshotHeader)
+    + sizeof(SnapshotBody) * num_bodies
+    + (sizeof(vec2) * 2 + sizeof(vec3)) * num_points
+    + (sizeof(vec2i) + sizeof(float)) * num_edges;
+}
+
+static void snapshot_view(SnapshotView* view, void* base) {
+  SnapshotHeader* header = base;
+  view->header = header;
+  view->bodies = (SnapshotBody*) (header + 1);
+  view->points = (vec2*) (view->bodies + header->num_bodies);
+  view->last_points = view->points + header->num_points;
+  view->colors = (vec3*) (view->last_points + header->num_points);
+  view->edges = (vec2i*) (view->colors + header->num_points);
+  view->lengths = (float*) (view->edges + header->num_edges);
+}
+
+static bool count_body(void* vbody, void* vcursor) {
+  Body* body = vbody;
+  SnapshotCursor* cursor = vcursor;
+  cursor->body++;
+  cursor->point += body->num_points;
+  cursor->edge += body->num_edges;
+  return false;
+}
+
+static uint32_t body_flags(Body* body) {
+  return (body->gravity? SNAPSHOT_GRAVITY : 0)
+    | (body->boxed? SNAPSHOT_BOXED : 0)
+    | (body->wire? SNAPSHOT_WIRE : 0)
+    | (body->rigid? SNAPSHOT_RIGID : 0)
+    | ((body->type == BODY_STATIC)? SNAPSHOT_STATIC : 0)
+    | ((body->type == BODY_KINEMATIC)? SNAPSHOT_KINEMATIC : 0);
+}
+
+static BodyType flags_type(uint32_t flags) {
+  return (flags & SNAPSHOT_STATIC)? BODY_STATIC
+    : (flags & SNAPSHOT_KINEMATIC)? BODY_KINEMATIC : BODY_DYNAMIC;
+}
+
+static void write_flags(Body* body, SnapshotBody* record) {
+  record->mass = body->mass;
+  record->mask = body->mask;
+  record->flags = body_flags(body);
+}
+
+static bool write_body(void* vbody, void* vcursor) {
+  Body* body = vbody;
+  SnapshotCursor* cursor = vcursor;
+  SnapshotView* view = cursor->view;
+  SnapshotBody* record = &view->bodies[cursor->body++];
+  int i;
+
+  body_sync_points(body);
+  record->first_point = cursor->point;
+  record->num_points = body->num_points;
+  record->first_edge = cursor->edge;
+  record->num_edges = body->num_edges;
+  write_flags(body, record);
+
+  memcpy(&view->points[cursor->point], body->points,
+    sizeof(vec2) * body->num_points);
+  memcpy(&view->last_points[cursor->point], body->last_points,
+    sizeof(vec2) * body->num_points);
+  memcpy(&view->colors[cursor->point], body->colors,
+    sizeof(vec3) * body->num_points);
+
+  // edges hold pointers into the body, store them as indices
+  for (i = 0; i < body->num_edges; i++) {
+    Edge* edge = &body->edges[i];
+    view->edges[cursor->edge + i][0] = edge->point1 - body->points;
+    view->edges[cursor->edge + i][1] = edge->point2 - body->points;
+    view->lengths[cursor->edge + i] = edge->length;
+  }
+
+  cursor->point += body->num_points;
+  cursor->edge += body->num_edges;
+  return false;
+}
+
+static void restore_flags(Body* body, SnapshotBody* record) {
+  body->mass = record->mass;
+  body->mask = record->mask;
+  body->gravity = (record->flags & SNAPSHOT_GRAVITY) != 0;
+  body->boxed = (record->flags & SNAPSHOT_BOXED) != 0;
+  body->wire = (record->flags & SNAPSHOT_WIRE) != 0;
+  body_set_rigid(body, (record->flags & SNAPSHOT_RIGID) != 0);
+  body_set_type(body, flags_type(record->flags));
+}
+
+// check a body against its record, before any body is restored
+static bool match_body(void* vbody, void* vcursor) {
+  Body* body = vbody;
+  SnapshotCursor* cursor = vcursor;
+  SnapshotBody* record = &cursor->view->bodies[cursor->body++];
+  if (record->num_points != (uint32_t) body->num_points
+    || record->num_edges != (uint32_t) body->num_edges)
+  {
+    cursor->ok = false;
+    return true;
+  }
+  return false;
+}
+
+static bool restore_body(void* vbody, void* vcursor) {
+  Body* body = vbody;
+  SnapshotCursor* cursor = vcursor;
+  SnapshotView* view = cursor->view;
+  SnapshotBody* record = &view->bodies[cursor->body++];
+  int i;
+
+  // rigid bodies take their shape and velocity from the restored points,
+  // and static ones go back in the static hierarchy
+  body_set_type(body, BODY_DYNAMIC);
+  body_set_rigid(body, false);
+  memcpy(body->points, &view->points[record->first_point],
+    sizeof(vec2) * body->num_points);
+  memcpy(body->last_points, &view->last_points[record->first_point],
+    sizeof(vec2) * body->num_points);
+  for (i = 0; i < body->num_edges; i++)
+    body->edges[i].length = view->lengths[record->first_edge + i];
+  restore_flags(body, record);
+
+  body_do_center(body->world, body);
+  return false;
+}
+
+// check that every body record stays inside the arrays it indexes
+static bool snapshot_valid(SnapshotView* view) {
+  uint32_t i, j;
+  for (i = 0; i < view->header->num_bodies; i++) {
+    SnapshotBody* record = &view->bodies[i];
+    // first + count could wrap, so compare count with what is left
+    if (record->num_points == 0
+      || record->first_point > view->header->num_points
+      || record->num_points > view->header->num_points - record->first_point
+      || record->first_edge > view->header->num_edges
+      || record->num_edges > view->header->num_edges - record->first_edge)
+      return false;
+    for (j = 0; j < record->num_edges; j++) {
+      vec2i* edge = &view->edges[record->first_edge + j];
+      if ((uint32_t) (*edge)[0] >= record->num_points
+        || (uint32_t) (*edge)[1] >= record->num_points)
+        return false;
+    }
+  }
+  return true;
+}
+
+// map a snapshot file and validate its contents
+static void* snapshot_map(const char* path, size_t* size, int prot, int flags) {
+  struct stat st;
+  void* base;
+  SnapshotHeader* header;
+  SnapshotView view;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("Could not open snapshot %s\n", path);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(SnapshotHeader)) {
+    printf("Snapshot %s is truncated\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  base = mmap(NULL, st.st_size, prot, flags, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("Could not map snapshot %s\n", path);
+    return NULL;
+  }
+
+  header = base;
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0
+    || header->version != SNAPSHOT_VERSION
+    || header->size != (uint32_t) st.st_size
+    || header->size != snapshot_size(header->num_bodies,
+      header->num_points, header->num_edges))
+  {
+    printf("Snapshot %s is invalid\n", path);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  snapshot_view(&view, base);
+  if (snapshot_valid(&view) == false) {
+    printf("Snapshot %s is corrupt\n", path);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  *size = st.st_size;
+  return base;
+}
+
+bool snapshot_save(World* world, const char* path) {
+  SnapshotCursor cursor = {0};
+  SnapshotView view;
+  size_t size;
+  void* base;
+  char temp[4096];
+
+  list_traverse(world->bodies, count_body, &cursor);
+  size = snapshot_size(cursor.body, cursor.point, cursor.edge);
+
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("Could not create snapshot %s\n", temp);
+    return false;
+  }
+
+  if (ftruncate(fd, size) < 0) {
+    printf("Could not size snapshot %s\n", temp);
+    close(fd);
+    unlink(temp);
+    return false;
+  }
+
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("Could not map snapshot %s\n", temp);
+    unlink(temp);
+    return false;
+  }
+
+  SnapshotHeader* header = base;
+  memcpy(header->magic, SNAPSHOT_MAGIC, 4);
+  header->version = SNAPSHOT_VERSION;
+  header->size = size;
+  header->num_bodies = cursor.body;
+  header->num_points = cursor.point;
+  header->num_edges = cursor.edge;
+
+  snapshot_view(&view, base);
+  cursor.view = &view;
+  cursor.body = cursor.point = cursor.edge = 0;
+  list_traverse(world->bodies, write_body, &cursor);
+
+  munmap(base, size);
+
+  if (rename(temp, path) < 0) {
+    printf("Could not replace snapshot %s\n", path);
+    unlink(temp);
+    return false;
+  }
+  return true;
+}
+
+bool snapshot_restore(World* world, const char* path) {
+  SnapshotCursor cursor = {0};
+  SnapshotView view;
+  size_t size;
+  void* base = snapshot_map(path, &size, PROT_READ, MAP_PRIVATE);
+  if (base == NULL)
+    return false;
+
+  snapshot_view(&view, base);
+  if (view.header->num_bodies != world->bodies->length) {
+    printf("Snapshot %s does not match the world\n", path);
+    munmap(base, size);
+    return false;
+  }
+
+  // a mismatch found part way through would leave the world half
+  // restored, so every body is checked first
+  cursor.view = &view;
+  cursor.ok = true;
+  list_traverse(world->bodies, match_body, &cursor);
+  if (cursor.ok) {
+    cursor.body = 0;
+    list_traverse(world->bodies, restore_body, &cursor);
+  }
+  munmap(base, size);
+
+  if (cursor.ok == false)
+    printf("Snapshot %s does not match the world\n", path);
+  return cursor.ok;
+}
+
+int snapshot_load(World* world, const char* path) {
+  SnapshotView view;
+  size_t size;
+  uint32_t i;
+  int j;
+
+  // mapping is kept, colors are used in place
+  void* base = snapshot_map(path, &size, PROT_READ, MAP_PRIVATE);
+  if (base == NULL)
+    return -1;
+
+  snapshot_view(&view, base);
+  for (i = 0; i < view.header->num_bodies; i++) {
+    SnapshotBody* record = &view.bodies[i];
+    Body* body = body_new(
+      &view.points[record->first_point],
+      &view.colors[record->first_point],
+      record->num_points,
+      &view.edges[record->first_edge],
+      record->num_edges);
+
+    memcpy(body->last_points, &view.last_points[record->first_point],
+      sizeof(vec2) * body->num_points);
+    for (j = 0; j < body->num_edges; j++)
+      body->edges[j].length = view.lengths[record->first_edge + j];
+    restore_flags(body, record);
+
+    world_add_body(world, body);
+  }
+
+  return view.header->num_bodies;
+}
+
+// a frame: points, last points, states, extra words, static version
+static size_t frame_words(SnapshotHistory* history) {
+  World* world = history->world;
+  return 4 * world->num_points
+    + world->next_id * (sizeof(SnapshotState) / 4)
+    + (history->extra_size + 3) / 4 + 1;
+}
+
+static SnapshotState* frame_states(SnapshotHistory* history,
+  uint32_t* frame)
+{
+  return (SnapshotState*) &frame[4 * history->world->num_points];
+}
+
+static void take_frame(SnapshotHistory* history, uint32_t* frame) {
+  World* world = history->world;
+  SnapshotState* states = frame_states(history, frame);
+  uint32_t* extra = (uint32_t*) &states[world->next_id];
+  int i;
+
+  // rigid bodies bring their points up to date before the pools are
+  // copied
+  for (i = 0; i < world->next_id; i++) {
+    Body* body = world->by_id[i];
+    SnapshotState* state = &states[i];
+    body_sync_points(body);
+    state->flags = body_flags(body);
+    state->lod = body->lod;
+    state->lod_hold = body->lod_hold;
+    memcpy(state->center_of_mass, body->center_of_mass, sizeof(vec2));
+    memcpy(state->bbox, body->bbox, sizeof(vec4));
+    memcpy(state->position, body->position, sizeof(vec2));
+    state->angle = body->angle;
+    memcpy(state->velocity, body->velocity, sizeof(vec2));
+    state->angular_velocity = body->angular_velocity;
+  }
+  memcpy(frame, world->points, sizeof(vec2) * world->num_points);
+  memcpy(&frame[2 * world->num_points], world->last_points,
+    sizeof(vec2) * world->num_points);
+
+  // padding is zeroed so it never shows up as a difference
+  if (history->extra_size > 0) {
+    extra[(history->extra_size + 3) / 4 - 1] = 0;
+    memcpy(extra, history->extra, history->extra_size);
+  }
+  frame[history->frame_words - 1] = world->static_version;
+}
+
+static void put_frame(SnapshotHistory* history, uint32_t* frame) {
+  World* world = history->world;
+  SnapshotState* states = frame_states(history, frame);
+  uint32_t* extra = (uint32_t*) &states[world->next_id];
+  int i;
+
+  // leaving rigid mode writes the points, so it goes before the pools
+  for (i = 0; i < world->next_id; i++) {
+    if ((states[i].flags & SNAPSHOT_RIGID) == 0)
+      body_set_rigid(world->by_id[i], false);
+  }
+  memcpy(world->points, frame, sizeof(vec2) * world->num_points);
+  memcpy(world->last_points, &frame[2 * world->num_points],
+    sizeof(vec2) * world->num_points);
+
+  for (i = 0; i < world->next_id; i++) {
+    Body* body = world->by_id[i];
+    SnapshotState* state = &states[i];
+
+    // a body that was rigid all along takes its exact pose back, one
+    // that wasn't takes its shape from the points
+    if (state->flags & SNAPSHOT_RIGID) {
+      if (body->rigid == false) {
+        body_set_rigid(body, true);
+      } else {
+        memcpy(body->position, state->position, sizeof(vec2));
+        body->angle = state->angle;
+        body->points_dirty = false;
+        body->points_touched = false;
+      }
+      memcpy(body->velocity, state->velocity, sizeof(vec2));
+      body->angular_velocity = state->angular_velocity;
+    }
+    body_set_type(body, flags_type(state->flags));
+    body->gravity = (state->flags & SNAPSHOT_GRAVITY) != 0;
+    body->boxed = (state->flags & SNAPSHOT_BOXED) != 0;
+    body->wire = (state->flags & SNAPSHOT_WIRE) != 0;
+    body->lod = state->lod;
+    body->lod_hold = state->lod_hold;
+    memcpy(body->center_of_mass, state->center_of_mass, sizeof(vec2));
+    memcpy(body->bbox, state->bbox, sizeof(vec4));
+    if (body->type != BODY_STATIC && body->proxy >= 0)
+      tree_move(world->dynamic_tree, body->proxy);
+  }
+
+  if (history->extra_size > 0)
+    memcpy(history->extra, extra, history->extra_size);
+
+  // the static set only changes through body_set_type, which counts
+  // every change, so the same count means the static tree still fits
+  if (frame[history->frame_words - 1] != world->static_version)
+    world->static_dirty = true;
+}
+
+// store the words of a frame that differ from the one after it, XORed,
+// as runs of {skip, count, words}
+static void encode_delta(SnapshotHistory* history, int slot,
+  uint32_t* frame, uint32_t* next)
+{
+  size_t n = history->frame_words, i = 0, j, k, size = 0;
+  uint32_t* delta = history->deltas[slot];
+
+  while (i < n) {
+    for (j = i; j < n && frame[j] == next[j]; j++);
+    if (j == n)
+      break;
+    for (k = j; k < n && frame[k] != next[k]; k++);
+
+    if (size + 2 + (k - j) > history->delta_capacity[slot]) {
+      history->delta_capacity[slot] = 2 * (size + 2 + (k - j)) + 64;
+      delta = realloc(delta, sizeof(uint32_t) * history->delta_capacity[slot]);
+      history->deltas[slot] = delta;
+    }
+    delta[size++] = j - i;
+    delta[size++] = k - j;
+    for (; j < k; j++)
+      delta[size++] = frame[j] ^ next[j];
+    i = k;
+  }
+  history->delta_words[slot] = size;
+}
+
+// turn a frame into the one before it
+static void apply_delta(SnapshotHistory* history, int slot, uint32_t* frame) {
+  uint32_t* delta = history->deltas[slot];
+  size_t size = history->delta_words[slot], i = 0, at = 0, count;
+
+  while (i < size) {
+    at += delta[i++];
+    count = delta[i++];
+    for (; count > 0; count--)
+      frame[at++] ^= delta[i++];
+  }
+}
+
+SnapshotHistory* snapshot_history_new(World* world, int frames,
+  void* extra, size_t extra_size)
+{
+  SnapshotHistory* history = calloc(1, sizeof(SnapshotHistory));
+  history->world = world;
+  history->extra = extra;
+  history->extra_size = (extra != NULL)? extra_size : 0;
+  history->capacity = (frames > 0)? frames : 1;
+  history->deltas = calloc(history->capacity, sizeof(uint32_t*));
+  history->delta_words = calloc(history->capacity, sizeof(size_t));
+  history->delta_capacity = calloc(history->capacity, sizeof(size_t));
+  return history;
+}
+
+void snapshot_history_free(SnapshotHistory* history) {
+  int i;
+  for (i = 0; i < history->capacity; i++)
+    free(history->deltas[i]);
+  free(history->deltas);
+  free(history->delta_words);
+  free(history->delta_capacity);
+  free(history->head);
+  free(history->scratch);
+  free(history);
+}
+
+void snapshot_history_push(SnapshotHistory* history) {
+  World* world = history->world;
+  uint32_t* frame;
+
+  // bodies were added, older frames no longer fit the world
+  if (history->num_bodies != world->next_id || history->head == NULL) {
+    history->num_bodies = world->next_id;
+    history->frame_words = frame_words(history);
+    history->head = realloc(history->head,
+      sizeof(uint32_t) * history->frame_words);
+    history->scratch = realloc(history->scratch,
+      sizeof(uint32_t) * history->frame_words);
+    history->num_frames = 0;
+  }
+
+  take_frame(history, history->scratch);
+  if (history->num_frames > 0)
+    encode_delta(history, history->newest % history->capacity,
+      history->head, history->scratch);
+  history->newest++;
+  if (history->num_frames < history->capacity)
+    history->num_frames++;
+
+  frame = history->head;
+  history->head = history->scratch;
+  history->scratch = frame;
+}
+
+bool snapshot_history_rewind(SnapshotHistory* history, int back) {
+  int i;
+
+  if (back < 0 || back >= history->num_frames
+    || history->num_bodies != history->world->next_id)
+    return false;
+
+  for (i = 1; i <= back; i++)
+    apply_delta(history, (history->newest - i) % history->capacity,
+      history->head);
+  put_frame(history, history->head);
+
+  // the head steps back once more to the newest frame left
+  history->num_frames -= back + 1;
+  history->newest -= back + 1;
+  if (history->num_frames > 0)
+    apply_delta(history, history->newest % history->capacity,
+      history->head);
+  return true;
+}
@@ -0,0 +1,173 @@
+/**
+ * Flat binary snapshots of the physics world
+ * @author Scott LaVigne
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "body.h"
+#include "world.h"
+
+#define SNAPSHOT_MAGIC "JPSN"
+#define SNAPSHOT_VERSION 1
+
+/**
+ * Body flag bits stored in a snapshot
+ */
+#define SNAPSHOT_GRAVITY 0x01
+#define SNAPSHOT_BOXED   0x02
+#define SNAPSHOT_WIRE    0x04
+#define SNAPSHOT_RIGID   0x08
+#define SNAPSHOT_STATIC  0x10
+#define SNAPSHOT_KINEMATIC 0x20
+
+/**
+ * File header. Every section after it is a tightly packed array of
+ * 4-byte values, in this order:
+ *   SnapshotBody bodies[num_bodies]
+ *   vec2         points[num_points]
+ *   vec2         last_points[num_points]
+ *   vec3         colors[num_points]
+ *   vec2i        edges[num_edges]   (indices local to their body)
+ *   float        lengths[num_edges] (edge rest lengths)
+ */
+typedef struct SnapshotHeader {
+
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t num_bodies;
+  uint32_t num_points;
+  uint32_t num_edges;
+
+} SnapshotHeader;
+
+typedef struct SnapshotBody {
+
+  uint32_t first_point;
+  uint32_t num_points;
+  uint32_t first_edge;
+  uint32_t num_edges;
+  float mass;
+  int32_t mask;
+  uint32_t flags;
+
+} SnapshotBody;
+
+/**
+ * What a history frame keeps of a body besides its points
+ */
+typedef struct SnapshotState {
+
+  uint32_t flags; // SNAPSHOT_* bits
+  int32_t lod;
+  int32_t lod_hold;
+  vec2 center_of_mass;
+  vec4 bbox;
+  vec2 position;  // rigid mode
+  float angle;
+  vec2 velocity;
+  float angular_velocity;
+
+} SnapshotState;
+
+/**
+ * The last few states of a world held in memory, cheap enough to take
+ * every tick for rollback. A frame is the world's point pools, a
+ * SnapshotState per body, some caller state and the static version,
+ * in one buffer of 4-byte words. Only the newest frame is kept whole;
+ * each older one is kept as the runs of words that differ from the
+ * frame after it, XORed, which are few since little moves in a tick.
+ * Buffers are reused, so taking frames doesn't allocate once warm.
+ */
+typedef struct SnapshotHistory {
+
+  World* world;
+  void* extra;        // caller state kept with each frame
+  size_t extra_size;
+  int capacity;       // most frames kept
+  int num_frames;
+  unsigned newest;    // number of the newest frame
+  int num_bodies;     // bodies in the world when frames were taken
+  size_t frame_words; // size of a whole frame
+
+  uint32_t* head;     // the newest frame
+  uint32_t* scratch;  // the frame being taken
+  uint32_t** deltas;  // by frame number % capacity, runs of
+                      // {skip, count, count words}
+  size_t* delta_words;
+  size_t* delta_capacity;
+
+} SnapshotHistory;
+
+/**
+ * Write every body in a world to a snapshot file. The file is
+ * written to a temporary path and renamed into place, so a crash
+ * never leaves a half-written checkpoint behind.
+ * @param  world a world
+ * @param  path  file path to write
+ * @return       true on success
+ */
+bool snapshot_save(World* world, const char* path);
+
+/**
+ * Restore the state of the bodies in a world from a snapshot.
+ * The world must hold the same bodies, in the same order, as when
+ * the snapshot was saved. A snapshot that doesn't match leaves every
+ * body as it was.
+ * @param  world a world
+ * @param  path  file path to read
+ * @return       true on success
+ */
+bool snapshot_restore(World* world, const char* path);
+
+/**
+ * Create new bodies from a snapshot and add them to a world.
+ * The file stays mapped for the life of the process, body colors
+ * point straight into the mapping.
+ * @param  world a world
+ * @param  path  file path to read
+ * @return       the number of bodies added, or -1 on failure
+ */
+int snapshot_load(World* world, const char* path);
+
+/**
+ * Create an empty history for a world. Bodies added to the world
+ * later empty it on the next push.
+ * @param  world      a world
+ * @param  frames     most frames kept
+ * @param  extra      caller state to keep with each frame, or NULL.
+ *                    It must not hold pointers that stepping changes.
+ * @param  extra_size its size in bytes
+ * @return            a new history
+ */
+SnapshotHistory* snapshot_history_new(World* world, int frames,
+  void* extra, size_t extra_size);
+
+/**
+ * Free a history. The world is untouched.
+ * @param history a history
+ */
+void snapshot_history_free(SnapshotHistory* history);
+
+/**
+ * Take the world's state as the newest frame. The oldest frame is
+ * dropped once there are as many as the history keeps.
+ * @param history a history
+ */
+void snapshot_history_push(SnapshotHistory* history);
+
+/**
+ * Put the world back as it was some frames ago. That frame and every
+ * newer one leave the history, so pushing again carries on from it.
+ * @param  history a history
+ * @param  back    frames back from the newest, 0 for the newest
+ * @return         false if the history doesn't go back that far
+ */
+bool snapshot_history_rewind(SnapshotHistory* history, int back);
+
+#endif /* SNAPSHOT_H */
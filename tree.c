@@ -0,0 +1,320 @@
+/**
+ * A dynamic bounding volume tree over bodies that move: implementation
+ * @author Scott LaVigne
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tree.h"
+
+#define TREE_STACK 64
+
+static int imax(int a, int b) {
+  return (a > b)? a : b;
+}
+
+static void bbox_union(vec4 a, vec4 b, vec4 out) {
+  out[0] = min(a[0], b[0]);
+  out[1] = min(a[1], b[1]);
+  out[2] = max(a[2], b[2]);
+  out[3] = max(a[3], b[3]);
+}
+
+static float bbox_perimeter(vec4 a) {
+  return 2.0 * ((a[2] - a[0]) + (a[3] - a[1]));
+}
+
+static bool bbox_contains(vec4 a, vec4 b) {
+  return a[0] <= b[0] && a[1] <= b[1] && a[2] >= b[2] && a[3] >= b[3];
+}
+
+static int alloc_node(Tree* tree) {
+  int i, index;
+
+  if (tree->free_list < 0) {
+    int old = tree->capacity;
+    tree->capacity = (old > 0)? old * 2 : 16;
+    tree->nodes = realloc(tree->nodes, sizeof(TreeNode) * tree->capacity);
+    for (i = old; i < tree->capacity; i++) {
+      tree->nodes[i].parent = (i + 1 < tree->capacity)? i + 1 : -1;
+      tree->nodes[i].height = -1;
+    }
+    tree->free_list = old;
+  }
+
+  index = tree->free_list;
+  tree->free_list = tree->nodes[index].parent;
+  tree->nodes[index].parent = -1;
+  tree->nodes[index].left = -1;
+  tree->nodes[index].right = -1;
+  tree->nodes[index].height = 0;
+  tree->nodes[index].body = NULL;
+  return index;
+}
+
+static void free_node(Tree* tree, int index) {
+  tree->nodes[index].parent = tree->free_list;
+  tree->nodes[index].height = -1;
+  tree->free_list = index;
+}
+
+// point a's parent at b instead
+static void replace_child(Tree* tree, int a, int b) {
+  int parent = tree->nodes[a].parent;
+  tree->nodes[b].parent = parent;
+  if (parent < 0)
+    tree->root = b;
+  else if (tree->nodes[parent].left == a)
+    tree->nodes[parent].left = b;
+  else
+    tree->nodes[parent].right = b;
+}
+
+// lift a grandchild of node a up a level. Returns the new subtree root.
+static int rotate(Tree* tree, int ia, int ib, int ic, bool c_is_right) {
+  TreeNode* nodes = tree->nodes;
+  TreeNode *a = &nodes[ia], *b = &nodes[ib], *c = &nodes[ic];
+  int ifs = c->left, ig = c->right;
+
+  replace_child(tree, ia, ic);
+  c->left = ia;
+  a->parent = ic;
+
+  // the taller grandchild stays with c, the other goes to a
+  if (nodes[ifs].height < nodes[ig].height) {
+    int t = ifs;
+    ifs = ig;
+    ig = t;
+  }
+  c->right = ifs;
+  if (c_is_right)
+    a->right = ig;
+  else
+    a->left = ig;
+  nodes[ig].parent = ia;
+
+  bbox_union(b->bbox, nodes[ig].bbox, a->bbox);
+  bbox_union(a->bbox, nodes[ifs].bbox, c->bbox);
+  a->height = 1 + imax(b->height, nodes[ig].height);
+  c->height = 1 + imax(a->height, nodes[ifs].height);
+  return ic;
+}
+
+// rotate the taller child up if the children's heights differ by two
+static int balance(Tree* tree, int ia) {
+  TreeNode* a = &tree->nodes[ia];
+  int ib = a->left, ic = a->right, diff;
+
+  if (a->left < 0 || a->height < 2)
+    return ia;
+
+  diff = tree->nodes[ic].height - tree->nodes[ib].height;
+  if (diff > 1)
+    return rotate(tree, ia, ib, ic, true);
+  if (diff < -1)
+    return rotate(tree, ia, ic, ib, false);
+  return ia;
+}
+
+// rebalance and refit every node from index up to the root
+static void refit(Tree* tree, int index) {
+  while (index >= 0) {
+    TreeNode* node;
+    index = balance(tree, index);
+    node = &tree->nodes[index];
+    node->height = 1 + imax(tree->nodes[node->left].height,
+      tree->nodes[node->right].height);
+    bbox_union(tree->nodes[node->left].bbox, tree->nodes[node->right].bbox,
+      node->bbox);
+    index = node->parent;
+  }
+}
+
+// cost of putting a leaf under a child, on top of what its parents pay
+static float descend_cost(Tree* tree, int child, vec4 box, float inherited) {
+  TreeNode* node = &tree->nodes[child];
+  vec4 joined;
+  bbox_union(node->bbox, box, joined);
+  if (node->left < 0)
+    return bbox_perimeter(joined) + inherited;
+  return bbox_perimeter(joined) - bbox_perimeter(node->bbox) + inherited;
+}
+
+static void insert_leaf(Tree* tree, int leaf) {
+  vec4 box, joined;
+  int index, sibling, parent;
+
+  if (tree->root < 0) {
+    tree->root = leaf;
+    tree->nodes[leaf].parent = -1;
+    return;
+  }
+
+  // walk down to the cheapest sibling by surface area heuristic
+  memcpy(box, tree->nodes[leaf].bbox, sizeof(vec4));
+  index = tree->root;
+  while (tree->nodes[index].left >= 0) {
+    TreeNode* node = &tree->nodes[index];
+    float area = bbox_perimeter(node->bbox);
+    float cost, inherited, cost_left, cost_right;
+    bbox_union(node->bbox, box, joined);
+    cost = 2.0 * bbox_perimeter(joined);
+    inherited = 2.0 * (bbox_perimeter(joined) - area);
+    cost_left = descend_cost(tree, node->left, box, inherited);
+    cost_right = descend_cost(tree, node->right, box, inherited);
+    if (cost < cost_left && cost < cost_right)
+      break;
+    index = (cost_left < cost_right)? node->left : node->right;
+  }
+  sibling = index;
+
+  // alloc_node can move the nodes, so no pointers are held across it
+  parent = alloc_node(tree);
+  replace_child(tree, sibling, parent);
+  bbox_union(tree->nodes[sibling].bbox, box, tree->nodes[parent].bbox);
+  tree->nodes[parent].height = tree->nodes[sibling].height + 1;
+  tree->nodes[parent].left = sibling;
+  tree->nodes[parent].right = leaf;
+  tree->nodes[sibling].parent = parent;
+  tree->nodes[leaf].parent = parent;
+
+  refit(tree, parent);
+}
+
+static void remove_leaf(Tree* tree, int leaf) {
+  int parent, sibling, grandparent;
+
+  if (leaf == tree->root) {
+    tree->root = -1;
+    return;
+  }
+
+  parent = tree->nodes[leaf].parent;
+  grandparent = tree->nodes[parent].parent;
+  sibling = (tree->nodes[parent].left == leaf)?
+    tree->nodes[parent].right : tree->nodes[parent].left;
+
+  replace_child(tree, parent, sibling);
+  free_node(tree, parent);
+  refit(tree, grandparent);
+}
+
+static void fatten(Tree* tree, int leaf) {
+  TreeNode* node = &tree->nodes[leaf];
+  node->bbox[0] = node->body->bbox[0] - TREE_MARGIN;
+  node->bbox[1] = node->body->bbox[1] - TREE_MARGIN;
+  node->bbox[2] = node->body->bbox[2] + TREE_MARGIN;
+  node->bbox[3] = node->body->bbox[3] + TREE_MARGIN;
+}
+
+Tree* tree_new() {
+  Tree* tree = malloc(sizeof(Tree));
+  tree->nodes = NULL;
+  tree->capacity = 0;
+  tree->free_list = -1;
+  tree->root = -1;
+  return tree;
+}
+
+void tree_free(Tree* tree) {
+  free(tree->nodes);
+  free(tree);
+}
+
+int tree_insert(Tree* tree, Body* body) {
+  int leaf = alloc_node(tree);
+  tree->nodes[leaf].body = body;
+  fatten(tree, leaf);
+  insert_leaf(tree, leaf);
+  return leaf;
+}
+
+void tree_remove(Tree* tree, int proxy) {
+  remove_leaf(tree, proxy);
+  free_node(tree, proxy);
+}
+
+bool tree_move(Tree* tree, int proxy) {
+  TreeNode* node = &tree->nodes[proxy];
+  if (bbox_contains(node->bbox, node->body->bbox))
+    return false;
+
+  remove_leaf(tree, proxy);
+  fatten(tree, proxy);
+  insert_leaf(tree, proxy);
+  return true;
+}
+
+// visit leaves overlapping a region, stopping when fn returns true
+static bool query(Tree* tree, vec4 bbox,
+  bool (*fn)(int, void*), void* data)
+{
+  int stack[TREE_STACK];
+  int top = 0;
+
+  if (tree->root < 0)
+    return false;
+
+  stack[top++] = tree->root;
+  while (top > 0) {
+    TreeNode* node = &tree->nodes[stack[--top]];
+    if (bbox_overlap(node->bbox, bbox) == false)
+      continue;
+    if (node->left < 0) {
+      if (fn(node - tree->nodes, data))
+        return true;
+    } else {
+      stack[top++] = node->left;
+      stack[top++] = node->right;
+    }
+  }
+  return false;
+}
+
+typedef struct TreeVisit {
+  Tree* tree;
+  bool (*fn)(Body*, void*);
+  void* data;
+} TreeVisit;
+
+static bool visit_body(int leaf, void* vvisit) {
+  TreeVisit* visit = vvisit;
+  return visit->fn(visit->tree->nodes[leaf].body, visit->data);
+}
+
+void tree_query(Tree* tree, vec4 bbox, bool (*fn)(Body*, void*), void* data) {
+  TreeVisit visit;
+  visit.tree = tree;
+  visit.fn = fn;
+  visit.data = data;
+  query(tree, bbox, visit_body, &visit);
+}
+
+void tree_raycast(Tree* tree, vec2 from, vec2 to,
+  float (*fn)(Body*, float, void*), void* data)
+{
+  int stack[TREE_STACK];
+  int top = 0;
+  float max_fraction = 1.0;
+  vec2 dir = {to[0] - from[0], to[1] - from[1]};
+
+  if (tree->root < 0)
+    return;
+
+  stack[top++] = tree->root;
+  while (top > 0) {
+    TreeNode* node = &tree->nodes[stack[--top]];
+    if (bbox_crossed(node->bbox, from, dir, max_fraction) == false)
+      continue;
+    if (node->left < 0) {
+      float fraction = fn(node->body, max_fraction, data);
+      if (fraction <= 0.0)
+        return;
+      max_fraction = min(max_fraction, fraction);
+    } else {
+      stack[top++] = node->left;
+      stack[top++] = node->right;
+    }
+  }
+}
@@ -0,0 +1,102 @@
+/**
+ * A dynamic bounding volume tree over bodies that move. Leaves hold
+ * fattened bboxes, so a body is only reinserted once it leaves its
+ * fat box, and the tree is kept balanced with rotations.
+ * @author Scott LaVigne
+ */
+#ifndef TREE_H
+#define TREE_H
+
+#include <stdbool.h>
+
+#include "body.h"
+
+/**
+ * How far a leaf's bbox reaches past its body's on every side
+ */
+#define TREE_MARGIN 10.0
+
+typedef struct TreeNode {
+
+  vec4 bbox;  // = {minX minY maxX maxY}, fattened for leaves
+  Body* body; // NULL for inner nodes
+  int parent; // next free node while on the free list
+  int left;   // child indices, -1 for leaves
+  int right;
+  int height; // 0 for leaves, -1 for free nodes
+
+} TreeNode;
+
+typedef struct Tree {
+
+  TreeNode* nodes;
+  int capacity;
+  int free_list; // -1 when every node is in use
+  int root;      // -1 when empty
+
+} Tree;
+
+/**
+ * Create an empty tree.
+ * @return a new tree
+ */
+Tree* tree_new();
+
+/**
+ * Free a tree.
+ * @param tree a tree
+ */
+void tree_free(Tree* tree);
+
+/**
+ * Add a body to the tree, using its current bbox.
+ * @param  tree a tree
+ * @param  body a body
+ * @return      the body's leaf, its proxy in the tree
+ */
+int tree_insert(Tree* tree, Body* body);
+
+/**
+ * Take a body out of the tree.
+ * @param tree  a tree
+ * @param proxy the body's leaf
+ */
+void tree_remove(Tree* tree, int proxy);
+
+/**
+ * Update a leaf after its body's bbox changed. Nothing happens while
+ * the bbox stays inside the fat one; otherwise the leaf is reinserted.
+ * @param  tree  a tree
+ * @param  proxy the body's leaf
+ * @return       true if the leaf was reinserted
+ */
+bool tree_move(Tree* tree, int proxy);
+
+/**
+ * Visit every body whose fat bbox overlaps a region.
+ * @param tree a tree
+ * @param bbox the region = {minX minY maxX maxY}
+ * @param fn   a function to apply. Its first argument is the body,
+ *             the second is extra data. If it ever returns true the
+ *             query ends. It must not change the tree.
+ * @param data extra data to pass to the function
+ */
+void tree_query(Tree* tree, vec4 bbox, bool (*fn)(Body*, void*), void* data);
+
+/**
+ * Visit every body whose fat bbox a segment crosses.
+ * @param tree a tree
+ * @param from start of the segment
+ * @param to   end of the segment
+ * @param fn   a function to apply. Its first argument is the body, the
+ *             second is how far along the segment the search still
+ *             reaches, from 0 to 1, the last is extra data. It returns
+ *             the new reach: 0 ends the search, a smaller fraction
+ *             clips the segment, and the same fraction goes on as is.
+ *             It must not change the tree.
+ * @param data extra data to pass to the function
+ */
+void tree_raycast(Tree* tree, vec2 from, vec2 to,
+  float (*fn)(Body*, float, void*), void* data);
+
+#endif /* TREE_H */
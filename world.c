@@ -0,0 +1,265 @@
+/**
+ * A physics world: implementation
+ * @author Scott LaVigne
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "world.h"
+#include "mem.h"
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+World* world_new() {
+  World* world = mem_calloc(MEM_WORLDS, 1, sizeof(World));
+  world->bodies = list_new();
+  world_set_bounds(world, 800.0, 600.0);
+  world->tick = 1.0 / 60.0;
+  world->iterations = 5;
+  world->gravity = 0.25;
+  world->static_tree = bvh_new();
+  world->static_dirty = true;
+  world->dynamic_tree = tree_new();
+  return world;
+}
+
+static bool free_body(void* body, void* data) {
+  body_free(body);
+  return false;
+}
+
+void world_free(World* world) {
+  list_traverse(world->bodies, free_body, NULL);
+  list_free(world->bodies);
+  bvh_free(world->static_tree);
+  tree_free(world->dynamic_tree);
+  mem_free(world->by_id);
+  mem_free(world->points);
+  mem_free(world->last_points);
+  mem_free(world->joints);
+  mem_free(world->static_bodies);
+  mem_free(world->candidates);
+  mem_free(world->query_candidates);
+  mem_free(world->query_found);
+  mem_free(world);
+}
+
+// move a body's points into the pool, growing it if need be
+static void pool_points(World* world, Body* body) {
+  vec2* own_points = body->points;
+  vec2* own_last_points = body->last_points;
+  int first = world->num_points, i;
+
+  if (first + body->num_points > world->point_capacity) {
+    int capacity = world->point_capacity * 2;
+    vec2* points;
+    vec2* last_points;
+    if (capacity < first + body->num_points)
+      capacity = first + body->num_points;
+    if (capacity < 256)
+      capacity = 256;
+    points = mem_alloc(MEM_POINTS, sizeof(vec2) * capacity);
+    last_points = mem_alloc(MEM_POINTS, sizeof(vec2) * capacity);
+    if (first > 0) {
+      memcpy(points, world->points, sizeof(vec2) * first);
+      memcpy(last_points, world->last_points, sizeof(vec2) * first);
+    }
+    for (i = 0; i < body->id; i++) {
+      Body* other = world->by_id[i];
+      body_move_points(other, &points[other->first_point],
+        &last_points[other->first_point]);
+    }
+    mem_free(world->points);
+    mem_free(world->last_points);
+    world->points = points;
+    world->last_points = last_points;
+    world->point_capacity = capacity;
+  }
+
+  memcpy(&world->points[first], body->points,
+    sizeof(vec2) * body->num_points);
+  memcpy(&world->last_points[first], body->last_points,
+    sizeof(vec2) * body->num_points);
+  body_move_points(body, &world->points[first], &world->last_points[first]);
+  body->first_point = first;
+  mem_free(own_points);
+  mem_free(own_last_points);
+  world->num_points += body->num_points;
+}
+
+void world_add_body(World* world, Body* body) {
+  body->world = world;
+  body->id = world->next_id++;
+  if (body->type == BODY_STATIC) {
+    world->static_dirty = true;
+    world->static_version++;
+  }
+  list_push_back(world->bodies, body);
+
+  if (body->id >= world->body_capacity) {
+    world->body_capacity = (world->body_capacity > 0)?
+      world->body_capacity * 2 : 64;
+    world->by_id = mem_realloc(MEM_WORLDS, world->by_id,
+      sizeof(Body*) * world->body_capacity);
+  }
+  world->by_id[body->id] = body;
+  pool_points(world, body);
+}
+
+void world_set_bounds(World* world, float width, float height) {
+  world->bounds[0] = world->view[0] = 0.0;
+  world->bounds[1] = world->view[1] = 0.0;
+  world->bounds[2] = world->view[2] = width;
+  world->bounds[3] = world->view[3] = height;
+}
+
+static bool do_lod(void* body, void* world) {
+  body_do_lod(world, body);
+  return false;
+}
+
+static bool do_step(void* body, void* world) {
+  body_do_step(world, body, ((World*) world)->tick);
+  return false;
+}
+
+static bool do_verlet(void* body, void* world) {
+  body_do_verlet(world, body, ((World*) world)->tick);
+  return false;
+}
+
+// frozen bodies skip constraints, reduced bodies only get the first pass
+static bool do_edges(void* vbody, void* iteration) {
+  Body* body = vbody;
+  if (body->lod == BODY_LOD_FULL
+    || (body->lod == BODY_LOD_REDUCED && *(int*) iteration == 0))
+    body_do_edges(body->world, body);
+  return false;
+}
+
+// static bodies don't move, their bbox stays put
+static bool do_center(void* vbody, void* world) {
+  Body* body = vbody;
+  if (body->type != BODY_STATIC)
+    body_do_center(world, body);
+  return false;
+}
+
+static bool do_collisions(void* body, void* world) {
+  body_do_collisions(world, body);
+  return false;
+}
+
+static bool do_pushes(void* body, void* data) {
+  body_apply_pushes(body);
+  return false;
+}
+
+void world_step(World* world) {
+  double start;
+  int i;
+
+  // levels of detail hang on distances and freezing on trigonometry
+  if (world->deterministic == false)
+    list_traverse(world->bodies, do_lod, world);
+  list_traverse(world->bodies, do_step, world);
+  list_traverse(world->bodies, do_verlet, world);
+
+  for (i = 0; i < world->iterations; i++) {
+    list_traverse(world->bodies, do_edges, &i);
+    joint_do_constraints(world);
+    list_traverse(world->bodies, do_center, world);
+    start = now();
+    list_traverse(world->bodies, do_collisions, world);
+    if (world->deterministic)
+      list_traverse(world->bodies, do_pushes, NULL);
+    world->stats.collide_time += now() - start;
+  }
+  world->stats.ticks++;
+}
+
+unsigned world_hash_point(unsigned hash, vec2 point) {
+  const unsigned char* bytes = (const unsigned char*) point;
+  size_t i;
+  for (i = 0; i < sizeof(vec2); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static bool hash_points(void* vbody, void* vhash) {
+  Body* body = vbody;
+  unsigned* hash = vhash;
+  int i;
+  body_sync_points(body);
+  for (i = 0; i < body->num_points; i++)
+    *hash = world_hash_point(*hash, body->points[i]);
+  return false;
+}
+
+unsigned world_checksum(World* world) {
+  unsigned hash = WORLD_CHECKSUM_SEED;
+  list_traverse(world->bodies, hash_points, &hash);
+  return hash;
+}
+
+void world_push_event(World* world, int key, bool down, double time) {
+  WorldEvent* event;
+  if (world->event_tail - world->event_head == WORLD_EVENT_CAPACITY) {
+    world->events_dropped++;
+    return;
+  }
+  event = &world->events[world->event_tail++ % WORLD_EVENT_CAPACITY];
+  event->time = time;
+  event->key = key;
+  event->down = down;
+}
+
+void world_process_input(World* world, double now) {
+  int i;
+  for (i = 0; i < WORLD_NUM_KEYS; i++) {
+    world->key_pressed[i] = false;
+    world->key_released[i] = false;
+  }
+
+  world->num_tick_events = 0;
+  while (world->event_head != world->event_tail) {
+    WorldEvent* event =
+      &world->events[world->event_head++ % WORLD_EVENT_CAPACITY];
+    if (event->down) {
+      world->key_pressed[event->key] = true;
+      world->key_held[event->key] = true;
+    } else {
+      world->key_held[event->key] = false;
+      world->key_released[event->key] = true;
+    }
+    world->tick_events[world->num_tick_events++] = *event;
+
+    world->latency_total += now - event->time;
+    world->latency_worst = max(world->latency_worst, now - event->time);
+    world->latency_count++;
+  }
+
+  if (world->events_dropped > 0) {
+    printf("Dropped %u input events\n", world->events_dropped);
+    world->events_dropped = 0;
+  }
+}
+
+int world_get_events(World* world, const WorldEvent** events) {
+  *events = world->tick_events;
+  return world->num_tick_events;
+}
+
+void world_get_input_latency(World* world, double* average, double* worst) {
+  *average = (world->latency_count > 0)?
+    world->latency_total / world->latency_count : 0.0;
+  *worst = world->latency_worst;
+}
@@ -0,0 +1,230 @@
+/**
+ * A physics world: its bodies, solver settings, broadphase, contacts
+ * and input. Worlds share nothing, so many can step at once.
+ * @author Scott LaVigne
+ */
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stdbool.h>
+
+#include "body.h"
+#include "bvh.h"
+#include "tree.h"
+#include "query.h"
+#include "list.h"
+#include "joint.h"
+
+/**
+ * Size of the keystate arrays. ASCII keys index the first 256 entries
+ * and GLUT special keys the rest, see WORLD_SPECIAL.
+ */
+#define WORLD_NUM_KEYS 512
+
+/**
+ * Keystate index of a GLUT special key, e.g. WORLD_SPECIAL(GLUT_KEY_UP)
+ */
+#define WORLD_SPECIAL(key) (256 + (key))
+
+/**
+ * Input events waiting for the next tick. Any more are dropped.
+ */
+#define WORLD_EVENT_CAPACITY 256
+
+/**
+ * A key going down or up
+ */
+typedef struct WorldEvent {
+
+  double time; // seconds, on the clock passed to world_process_input
+  int key;     // keystate index
+  bool down;
+
+} WorldEvent;
+
+/**
+ * Counts of the work done by ticks. Nothing resets them but the owner.
+ */
+typedef struct WorldStats {
+
+  unsigned ticks;
+  unsigned iterations;  // edge constraint passes over a body
+  unsigned pairs;       // pairs the broadphase turned up
+  unsigned hits;        // pairs the narrowphase found touching
+  unsigned contacts;    // contacts resolved
+  double collide_time;  // seconds spent in collision passes
+
+} WorldStats;
+
+struct World {
+
+  List* bodies;
+  Body** by_id;  // every body, indexed by id
+  int body_capacity;
+  vec4 bounds;  // boxed bodies stay inside = {minX minY maxX maxY}
+  vec4 view;    // level of detail is measured from here
+  int next_id;
+
+  // every body's points, side by side in the order they were added,
+  // so the whole state can be copied at once
+  vec2* points;
+  vec2* last_points;
+  int num_points;
+  int point_capacity;
+
+  // joints between bodies, sorted by color, see joint.h
+  Joint* joints;
+  int num_joints;
+  int joint_capacity;
+  int color_starts[JOINT_COLORS + 1]; // first joint of each color
+  int num_colors;
+  bool joints_dirty; // joints were added since they were colored
+
+  // solver settings
+  double tick;     // seconds a step stands for, passed to step callbacks
+  int iterations;  // constraint and collision passes per step
+  float gravity;   // fall per step squared
+  bool deterministic; // see world_step
+
+  // broadphase
+  Bvh* static_tree;     // every static body
+  bool static_dirty;
+  unsigned static_version; // counts changes to the set of static bodies
+  Body** static_bodies; // scratch for rebuilding the static tree
+  int static_capacity;
+  Tree* dynamic_tree;   // every body that isn't static
+  Body** candidates;    // bodies a collision query turned up
+  int num_candidates;
+  int candidate_capacity;
+
+  // narrowphase, the contact being resolved
+  Contact contact;
+
+  // scratch for queries
+  Body** query_candidates;
+  int num_query_candidates;
+  int query_candidate_capacity;
+  QueryHit* query_found;
+  int num_query_found;
+  int query_found_capacity;
+
+  // input, built from events at the start of each tick
+  bool key_pressed[WORLD_NUM_KEYS];  // went down this tick
+  bool key_held[WORLD_NUM_KEYS];     // is down
+  bool key_released[WORLD_NUM_KEYS]; // went up this tick
+  WorldEvent events[WORLD_EVENT_CAPACITY];
+  unsigned event_head, event_tail;
+  WorldEvent tick_events[WORLD_EVENT_CAPACITY];
+  int num_tick_events;
+  unsigned events_dropped;
+  double latency_total, latency_worst;
+  unsigned latency_count;
+
+  WorldStats stats;
+
+};
+
+/**
+ * Create an empty world, 800x600, stepping at 60Hz with five
+ * iterations.
+ * @return a new world
+ */
+World* world_new();
+
+/**
+ * Free a world, its broadphase, its joints and every body still in
+ * it, with their pooled points.
+ * @param world a world
+ */
+void world_free(World* world);
+
+/**
+ * Add a body to a world. A body belongs to one world. Its points move
+ * to the world's point pool, and move again whenever the pool grows,
+ * so pointers to them don't outlive the next body added.
+ * @param world a world
+ * @param body  a body to add
+ */
+void world_add_body(World* world, Body* body);
+
+/**
+ * Set the region boxed bodies are kept inside, and the view level of
+ * detail is measured from.
+ * @param world  a world
+ * @param width  world width
+ * @param height world height
+ */
+void world_set_bounds(World* world, float width, float height);
+
+/**
+ * Step a world once: level of detail, step callbacks, integration,
+ * then the constraint and collision passes. Each constraint pass runs
+ * every body's edges, then every joint.
+ *
+ * A deterministic world gives the same bits on any machine and in any
+ * order its pairs are handled: levels of detail are skipped, edge and
+ * axis lengths come from rsqrt, and contact pushes are summed in fixed
+ * point and applied after each collision pass. A deterministic fleet
+ * copy steps exactly as a deterministic world does. Rigid bodies still
+ * rotate with the C library's trigonometry.
+ * @param world a world
+ */
+void world_step(World* world);
+
+/**
+ * Starting value of a checksum
+ */
+#define WORLD_CHECKSUM_SEED 2166136261u
+
+/**
+ * Hash the points of every body, in the order they were added, to
+ * compare runs for replays and lockstep. fleet_checksum hashes a copy
+ * the same way.
+ * @param  world a world
+ * @return       FNV-1a hash of the point bits
+ */
+unsigned world_checksum(World* world);
+
+/**
+ * Fold a point's bits into a checksum
+ * @param  hash  the checksum so far
+ * @param  point a point
+ * @return       the new checksum
+ */
+unsigned world_hash_point(unsigned hash, vec2 point);
+
+/**
+ * Queue a key event for the next tick.
+ * @param world a world
+ * @param key   keystate index
+ * @param down  true if the key went down
+ * @param time  when it happened, in seconds
+ */
+void world_push_event(World* world, int key, bool down, double time);
+
+/**
+ * Consume every queued event, oldest first, into the keystate arrays.
+ * A key pressed and released within one tick is both pressed and
+ * released. Call at the start of each tick.
+ * @param world a world
+ * @param now   the time, on the same clock as the events
+ */
+void world_process_input(World* world, double now);
+
+/**
+ * Get the events the current tick consumed, oldest first.
+ * @param  world  a world
+ * @param  events set to the events, valid until the next tick
+ * @return        the number of events
+ */
+int world_get_events(World* world, const WorldEvent** events);
+
+/**
+ * Get how long events waited between arriving and being consumed.
+ * @param world   a world
+ * @param average set to the mean wait in seconds
+ * @param worst   set to the longest wait in seconds
+ */
+void world_get_input_latency(World* world, double* average, double* worst);
+
+#endif /* WORLD_H */